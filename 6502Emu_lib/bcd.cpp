@@ -0,0 +1,24 @@
+#include "bcd.hpp"
+#include <utility>
+
+namespace bcd{
+    template<Result (*Operation)(uint8_t, uint16_t, bool)>
+    static constexpr Row make_row(uint8_t a){
+        Row row{};
+        for (unsigned data = 0; data < 0x100; data++){
+            row[data << 1] = Operation(a, data, false);
+            row[data << 1 | 1] = Operation(a, data, true);
+        }
+        return row;
+    }
+
+    template<Result (*Operation)(uint8_t, uint16_t, bool), std::size_t... A>
+    static constexpr Table make_table(std::index_sequence<A...>){
+        return {make_row<Operation>(A)...};
+    }
+
+    #if ENABLE_BCD_TABLES
+    constexpr Table adc_table = make_table<adc>(std::make_index_sequence<0x100>{});
+    constexpr Table sbc_table = make_table<sbc>(std::make_index_sequence<0x100>{});
+    #endif
+}
@@ -0,0 +1,79 @@
+#ifndef BCD
+#define BCD
+#include "types.h"
+#include <array>
+#include <bit>
+
+#ifndef ENABLE_BCD_TABLES
+#define ENABLE_BCD_TABLES 0 // decimal-mode ADC/SBC look their results up instead of doing nibble arithmetic
+#endif
+
+/// Decimal-mode ADC/SBC, as arithmetic and as tables indexed by (A, operand, C).
+namespace bcd{
+    /// Flag bits of `Result::flags`, in their `PS.conv()` positions.
+    constexpr uint8_t N = 0x80, V = 0x40, Z = 0x02, C = 0x01;
+
+    struct Result{
+        uint8_t value; /// new accumulator
+        uint8_t flags; /// N, V, Z and C; every other bit is 0
+    };
+
+    /// Decimal ADC. `data` is 16 bits wide because (zp),Y operands are.
+    constexpr Result adc(uint8_t a, uint16_t data, bool carry){
+        uint8_t lower = (uint8_t)(data & 0x0F) + (a & 0x0F) + carry;
+        if (lower > 0x9) lower += 6;
+
+        uint8_t upper = (uint8_t)(data >> 4) + (a >> 4) + (lower > 0x0F);
+        if (upper > 0x9) upper += 6;
+
+        uint8_t h1 = a >> 4;
+        uint8_t h2 = (uint8_t)data >> 4;
+        uint8_t s1 = (h1 & 0x8) ? h1 - 0x0F : h1;
+        uint8_t s2 = (h2 & 0x8) ? h2 - 0x0F : h2;
+        int8_t s = std::bit_cast<int8_t, uint8_t>(s1+s2);
+
+        uint8_t value = (upper << 4) | (lower & 0xF);
+        uint8_t flags = 0;
+        if (s < -8 || s > 7) flags |= V;
+        if (upper > 0xF) flags |= C;
+        if (value == 0) flags |= Z;
+        if ((upper >> 3) & 1) flags |= N;
+        return {value, flags};
+    }
+
+    /// Decimal SBC. `data` is 16 bits wide because (zp),Y operands are.
+    constexpr Result sbc(uint8_t a, uint16_t data, bool carry){
+        uint16_t result = a - data - !carry;
+        // split upper and lower into separate bytes for calculation.
+        uint8_t lower = (a & 0x0F) - (data & 0x0F) - !carry;
+        if (lower & 0x80) lower -= 6; // 0x80 - 0x6 = 0xA (make lower digit wrap between 0x0 and 0x9)
+
+        uint8_t upper = (a >> 4) - (data >> 4) - (lower >> 7); // subtract 1 if lower digit overflowed
+        if (upper & 0x80) upper -= 6;
+
+        uint8_t value = (upper << 4) | (lower & 0xF);
+        uint8_t flags = 0;
+        if ((((uint16_t)a ^ data) & ((uint16_t)a ^ result) & 0x80) > 0) flags |= V;
+        if ((result & 0xFF00) == 0) flags |= C;
+        if (value == 0) flags |= Z;
+        if ((upper >> 7) & 1) flags |= N;
+        return {value, flags};
+    }
+
+    /// One row per accumulator value, one entry per (8-bit operand, C) in it: 128K entries, 256 KiB.
+    using Row = std::array<Result, 0x200>;
+    using Table = std::array<Row, 0x100>;
+
+    constexpr auto lookup(const Table& table, uint8_t a, uint8_t data, bool carry) -> const Result& {
+        return table[a][data << 1 | carry];
+    }
+
+    #if ENABLE_BCD_TABLES
+    /// Tables generated from `adc`/`sbc` at compile time in bcd.cpp. Only built with ENABLE_BCD_TABLES, so other
+    /// builds do not carry their 512 KiB.
+    extern const Table adc_table;
+    extern const Table sbc_table;
+    #endif
+}
+
+#endif
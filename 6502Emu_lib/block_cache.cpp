@@ -0,0 +1,228 @@
+#include "block_cache.hpp"
+#include "instruction.hpp"
+#include "jit.hpp"
+#include <stdexcept>
+
+/// Whether `opcode` transfers control (branch, JMP, JSR, RTS, RTI, BRK) or is unimplemented,
+/// in which case it is the last instruction of its block.
+static bool ends_block(uint8_t opcode){
+    const InstructionInfo& info = instruction_info.get(opcode);
+    if (info.opcode != opcode || info.mode == RELATIVE)
+        return true;
+    switch (opcode){
+        case 0x00: // BRK
+        case 0x20: // JSR
+        case 0x40: // RTI
+        case 0x4C: // JMP abs
+        case 0x60: // RTS
+        case 0x6C: // JMP ind
+            return true;
+        default:
+            return false;
+    }
+}
+
+/// Whether `addr` falls inside `block`, taking wrap-around at the top of memory into account.
+static bool block_contains(const Block& block, uint16_t addr){
+    return (uint32_t)(uint16_t)(addr - block.start) < block.end - block.start;
+}
+
+/// Calls `func` with the number of every page `block` has at least one byte in.
+template<typename F>
+static void for_each_page(const Block& block, F func){
+    std::size_t first = block.start / Mem::PAGE_SIZE;
+    std::size_t last = (block.end - 1) / Mem::PAGE_SIZE;
+    for (std::size_t page = first; page <= last; page++)
+        func(page % Mem::PAGES);
+}
+
+/// Decodes the instruction at `addr` into `out` without side effects. Returns false if any of its bytes cannot be
+/// peeked.
+static bool fetch(const Mem& memory, uint16_t addr, DecodedInstruction& out){
+    auto opcode = memory.peek(addr);
+    if (!opcode)
+        return false;
+    const Instruction& instr = instruction_table.get(*opcode);
+    operands op = 0;
+    for (int i = instr.length - 1; i > 0; i--){
+        auto byte = memory.peek((uint16_t)(addr + i));
+        if (!byte)
+            return false;
+        op = op << 8 | *byte;
+    }
+    out = {instruction_table.handler(instr), op, instr.length, instr.base_cycles, *opcode};
+    return true;
+}
+
+BlockCache::BlockCache(Mem& memory) : memory(memory){
+    memory.code_write_handler = on_code_write;
+    memory.code_write_context = this;
+}
+
+BlockCache::~BlockCache(){
+    for (std::size_t page = 0; page < Mem::PAGES; page++)
+        memory.set_code_page(page, false);
+    memory.code_write_handler = nullptr;
+    memory.code_write_context = nullptr;
+}
+
+cycle_timestamp BlockCache::run(Cpu& cpu, cycle_timestamp now){
+    while (now < cpu.slice_end){
+        retired.clear(); // nothing is running at this point
+        invalidated = false;
+        Block* found = lookup(cpu.PC);
+        if (!found){
+            cpu.cycle_count = now;
+            now += cpu.step();
+            continue;
+        }
+        Block& block = *found;
+        if (compiler && !block.native && ++block.entries == Jit::HOT_THRESHOLD)
+            compile(block);
+        if (block.native){
+            now = block.native(&cpu, now, &invalidated);
+            continue;
+        }
+        const auto& instructions = block.instructions;
+        for (std::size_t i = 0; i < instructions.size(); i++){
+            const DecodedInstruction& instr = instructions[i];
+            cpu.cycle_count = now;
+            // A pair only runs fused if the first instruction cannot reach the end of the slice on its own
+            // (base cycles plus a page-crossing cycle), so the run stops at the same place either way.
+            if (instr.pair && now + instr.base_cycles + 1 < cpu.slice_end){
+                const DecodedInstruction& next = instructions[++i];
+                cpu.PC += instr.length + next.length;
+                now += instr.pair(cpu, (operands)(instr.op | next.op << 8));
+            } else {
+                cpu.PC += instr.length;
+                now += instr.handler(cpu, instr.op);
+            }
+            if (now >= cpu.slice_end || invalidated)
+                break;
+        }
+    }
+    return now;
+}
+
+Block* BlockCache::lookup(uint16_t pc){
+    auto& page = pages[pc / Mem::PAGE_SIZE];
+    if (!page)
+        page = std::make_unique<PageIndex>();
+    auto& slot = page->entry[pc % Mem::PAGE_SIZE];
+    if (slot)
+        return slot.get();
+
+    slot = decode(pc);
+    if (!slot)
+        return nullptr;
+    decodes++;
+    blocks++;
+    for_each_page(*slot, [&](std::size_t p){
+        if (!pages[p])
+            pages[p] = std::make_unique<PageIndex>();
+        pages[p]->overlapping.push_back(slot.get());
+        memory.set_code_page(p, true);
+    });
+    return slot.get();
+}
+
+std::unique_ptr<Block> BlockCache::decode(uint16_t pc) const{
+    auto block = std::make_unique<Block>();
+    block->start = pc;
+    block->base_cycles = 0;
+    uint32_t addr = pc;
+    DecodedInstruction decoded;
+    while (block->instructions.size() < MAX_BLOCK_INSTRUCTIONS && fetch(memory, (uint16_t)addr, decoded)){
+        block->instructions.push_back(decoded);
+        block->base_cycles += decoded.base_cycles;
+        addr += decoded.length;
+        if (ends_block(decoded.opcode) || addr >= Mem::MEM_LEN)
+            break;
+    }
+    if (block->instructions.empty())
+        return nullptr;
+    block->end = addr;
+
+    auto& instructions = block->instructions;
+    for (std::size_t i = 0; i + 1 < instructions.size(); i++){
+        instructions[i].pair = superinstruction(instructions[i].opcode, instructions[i + 1].opcode);
+        if (instructions[i].pair)
+            i++;
+    }
+    return block;
+}
+
+bool BlockCache::enable_jit(const Cpu& cpu){
+    if (compiler)
+        return true;
+    if (!Jit::available())
+        return false;
+    try {
+        compiler = std::make_unique<Jit>(cpu);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+void BlockCache::compile(Block& block){
+    block.native = compiler->compile(block);
+    if (compiler->broken()){
+        // The host took back execute permission: stay with the interpreter from now on.
+        drop_native_code();
+        compiler.reset();
+        return;
+    }
+    if (block.native || !compiler->full())
+        return; // translated, or not worth translating
+    // Code buffer is full: drop all native code and start filling it again.
+    drop_native_code();
+    compiler->reset();
+    block.native = compiler->compile(block);
+}
+
+void BlockCache::drop_native_code(){
+    for (auto& page : pages){
+        if (!page) continue;
+        for (Block* cached : page->overlapping){
+            cached->native = nullptr;
+            cached->entries = 0;
+        }
+    }
+}
+
+void BlockCache::invalidate(uint16_t addr){
+    auto& page = pages[addr / Mem::PAGE_SIZE];
+    if (!page)
+        return;
+    auto& overlapping = page->overlapping;
+    for (std::size_t i = 0; i < overlapping.size();){
+        if (block_contains(*overlapping[i], addr))
+            retire(overlapping[i]); // removes it from `overlapping`
+        else
+            i++;
+    }
+}
+
+void BlockCache::clear(){
+    for (auto& page : pages){
+        while (page && !page->overlapping.empty())
+            retire(page->overlapping.back());
+    }
+}
+
+void BlockCache::retire(Block* block){
+    for_each_page(*block, [&](std::size_t p){
+        std::erase(pages[p]->overlapping, block);
+        if (pages[p]->overlapping.empty())
+            memory.set_code_page(p, false);
+    });
+    auto& slot = pages[block->start / Mem::PAGE_SIZE]->entry[block->start % Mem::PAGE_SIZE];
+    retired.push_back(std::move(slot));
+    blocks--;
+    invalidated = true;
+}
+
+void BlockCache::on_code_write(void* context, uint16_t addr){
+    static_cast<BlockCache*>(context)->invalidate(addr);
+}
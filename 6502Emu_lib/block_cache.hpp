@@ -0,0 +1,97 @@
+#ifndef BLOCK_CACHE
+#define BLOCK_CACHE
+#include "types.h"
+#include "mem.hpp"
+#include <array>
+#include <memory>
+#include <vector>
+
+class Cpu;
+class Jit;
+
+/// Native code for a block, produced by the JIT. Runs the block from its first instruction and returns the new
+/// cycle timestamp; stops early once `cpu->slice_end` is reached or `*invalidated` is set, like the interpreter.
+using native_block = cycle_timestamp(*)(Cpu* cpu, cycle_timestamp now, const bool* invalidated);
+
+/// One predecoded instruction: everything needed to run it without touching the opcode table or re-reading
+/// its operand bytes from memory.
+struct DecodedInstruction{
+    instruction_function<Cpu&> handler;
+    operands op;
+    uint8_t length;
+    uint8_t base_cycles;
+    uint8_t opcode;
+    instruction_function<Cpu&> pair = nullptr; /// superinstruction for this and the next instruction, if any
+};
+
+/// A run of straight-line code, decoded once. Ends with (and includes) the first branch, JMP, JSR, RTS, RTI or BRK.
+struct Block{
+    uint16_t start;
+    uint32_t end; /// one past the last byte of the block
+    cycles base_cycles; /// sum of the base cycles of every instruction in the block
+    std::vector<DecodedInstruction> instructions;
+    uint32_t entries = 0; /// how often the block has been entered; it is offered to the JIT once, on becoming hot
+    native_block native = nullptr; /// compiled code, if the JIT has translated this block
+};
+
+/** Cache of predecoded basic blocks, keyed by start PC.
+ *
+ * Pages that hold cached code are flagged in `Mem::code_pages`; any write through `Mem::set` into such a page
+ * drops the blocks overlapping the written address, so self-modifying code keeps working.
+ *
+ * Blocks are decoded with `Mem::peek`, so decoding never reads I/O registers or trips watchpoints. A block ends
+ * before the first instruction that cannot be peeked; code on such pages runs one fetched instruction at a time.
+ */
+class BlockCache{
+public:
+    static const std::size_t MAX_BLOCK_INSTRUCTIONS = 64;
+
+    explicit BlockCache(Mem& memory);
+    ~BlockCache();
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    /// Runs cached blocks from `cpu.PC` until `now` reaches `cpu.slice_end`. Returns the new cycle timestamp.
+    cycle_timestamp run(Cpu& cpu, cycle_timestamp now);
+
+    /// Returns the block starting at `pc`, decoding it first if it is not cached yet. Returns null if the first
+    /// instruction cannot be read ahead of running it (see `Mem::peek`); it then has to be fetched as it runs.
+    Block* lookup(uint16_t pc);
+
+    /// Turns on translation of hot blocks to native code. Returns false (and stays interpreted) if the
+    /// JIT is not available on this host.
+    bool enable_jit(const Cpu& cpu);
+    Jit* jit() const { return compiler.get(); }
+
+    /// Drops every block containing `addr`.
+    void invalidate(uint16_t addr);
+    /// Drops every block.
+    void clear();
+
+    std::size_t block_count() const { return blocks; }
+    std::size_t decode_count() const { return decodes; }
+
+private:
+    struct PageIndex{
+        std::array<std::unique_ptr<Block>, Mem::PAGE_SIZE> entry; /// blocks starting in this page, by page offset
+        std::vector<Block*> overlapping; /// every cached block with at least one byte in this page
+    };
+
+    Mem& memory;
+    std::array<std::unique_ptr<PageIndex>, Mem::PAGES> pages;
+    std::vector<std::unique_ptr<Block>> retired; /// invalidated blocks, kept alive until they can no longer be running
+    bool invalidated = false; /// set when a write drops a block, so a running block stops at the next instruction
+    std::unique_ptr<Jit> compiler;
+    std::size_t blocks = 0;
+    std::size_t decodes = 0;
+
+    std::unique_ptr<Block> decode(uint16_t pc) const;
+    /// Hands `block` to the JIT once it is hot. Blocks the JIT turns down stay interpreted.
+    void compile(Block& block);
+    /// Forgets the native code of every block, which will be counted as cold again.
+    void drop_native_code();
+    void retire(Block* block);
+    static void on_code_write(void* context, uint16_t addr);
+};
+
+#endif
@@ -1,19 +1,144 @@
 #include "cpu.hpp"
 #include "instruction.hpp"
+#include <algorithm>
 #include <fmt/ostream.h>
 #include <fmt/color.h>
 
-static const InstructionTable table;
-
-void Cpu::execute_instruction() {
-    #if ENABLE_INSTRUCTION_DEBUG_INFO
-    DecompiledInstruction d_instr(table, memory, (std::size_t)PC);
+/// Fetches, decodes and runs one instruction. Shared by `execute_instruction`, the run loop and the block cache.
+/// The operand bytes are fetched here and the PC is moved past the instruction before its handler runs.
+cycles Cpu::step() {
+    const Instruction& instr = instruction_table.get(this->memory.get(this->PC));
+    operands op = 0;
+    switch (instr.length){
+        case 3:
+            op = this->memory.get((uint16_t)(this->PC + 2)) << 8;
+            [[fallthrough]];
+        case 2:
+            op |= this->memory.get((uint16_t)(this->PC + 1));
+    }
+    this->PC += instr.length;
+    return instruction_table.handler(instr)(*this, op);
+}
+
+cycles Cpu::execute_instruction() {
+    #if ENABLE_INSTRUCTION_TRACE
+    DecompiledInstruction d_instr(instruction_info, memory, (std::size_t)PC);
     fmt::print(fmt::emphasis::bold | fmt::fg(fmt::color::aqua),
         "{}\n", d_instr.to_string());
-    #endif;
-    Instruction instr = table.get(this->memory.get(this->PC++));
-    AddressingMode mode = instr.mode;
-    cycles cyc = instr.run(*this);
+    #endif
+    cycles cyc;
+    if (interrupt_pending()) {
+        cyc = take_interrupt();
+    } else {
+        if (pair_profile)
+            pair_profile->record(memory.get(PC));
+        cyc = step();
+    }
+    cycle_count += cyc;
+    if (cycle_count >= scheduler.next())
+        scheduler.fire_due(cycle_count);
+    return cyc;
+}
+
+cycles Cpu::run_for(cycles budget) {
+    cycle_timestamp start = cycle_count;
+    return run_until(start + budget) - start;
+}
+
+cycle_timestamp Cpu::run_until(cycle_timestamp timestamp) {
+    // Devices and interrupt lines are only looked at between slices. A slice runs up to the next event, or ends
+    // early when an interrupt becomes takeable (see `slice_end`).
+    while (cycle_count < timestamp) {
+        if (interrupt_pending())
+            cycle_count += take_interrupt();
+        cycle_count = run_to(std::min(timestamp, scheduler.next()));
+        scheduler.fire_due(cycle_count);
+    }
+    return cycle_count;
+}
+
+cycle_timestamp Cpu::run_to(cycle_timestamp timestamp) {
+    // The counter lives in a local for the whole loop; `run_until` writes it back. Each core also stores it to
+    // `cycle_count` before running an instruction, so devices touched by it can catch up, but never reads it back.
+    // Registers stay in the Cpu because every handler operates on `Cpu&`.
+    cycle_timestamp now = cycle_count;
+    slice_end = timestamp;
+    if (pair_profile) {
+        while (now < slice_end) {
+            pair_profile->record(memory.get(PC));
+            cycle_count = now;
+            now += step();
+        }
+    } else if (block_cache) {
+        now = block_cache->run(*this, now);
+    } else {
+        #if ENABLE_THREADED_INTERPRETER
+        now = run_threaded(*this, now);
+        #else
+        while (now < slice_end) {
+            cycle_count = now;
+            now += step();
+        }
+        #endif
+    }
+    return now;
+}
+
+void Cpu::set_irq(bool asserted, uint32_t source) {
+    irq_sources = asserted ? irq_sources | source : irq_sources & ~source;
+    irq_mask_changed();
+}
+
+void Cpu::set_nmi(bool asserted) {
+    if (asserted && !nmi_line) {
+        nmi_pending = true;
+        slice_end = 0;
+    }
+    nmi_line = asserted;
+}
+
+void Cpu::enter_interrupt(uint16_t vector, bool brk) {
+    push(PC >> 8);
+    push(PC & 0x00FF);
+    push((PS.conv() & ~0x30) | (brk ? 0x30 : 0x20));
+    PS.I = 1;
+    PC = memory.get(vector) | (memory.get(vector + 1) << 8);
+}
+
+cycles Cpu::take_interrupt() {
+    constexpr cycles cyc = 7;
+    bool nmi = nmi_pending;
+    nmi_pending = false;
+    enter_interrupt(nmi ? NMI_VECTOR : IRQ_VECTOR, false);
+    return cyc;
+}
+
+Cpu::Cpu(Cpu& parent, Mem::Fork)
+    : frequency(parent.frequency), cycle_count(parent.cycle_count), memory(parent.memory, Mem::Fork{}),
+      A(parent.A), X(parent.X), Y(parent.Y), SP(parent.SP), PC(parent.PC), PS(parent.PS) {
+}
+
+std::unique_ptr<Cpu> Cpu::fork() {
+    return std::unique_ptr<Cpu>(new Cpu(*this, Mem::Fork{}));
+}
+
+void Cpu::enable_block_cache(bool enable) {
+    if (!enable)
+        block_cache.reset();
+    else if (!block_cache)
+        block_cache = std::make_unique<BlockCache>(memory);
+}
+
+void Cpu::enable_pair_profile(bool enable) {
+    if (!enable)
+        pair_profile.reset();
+    else if (!pair_profile)
+        pair_profile = std::make_unique<OpcodePairProfile>();
+}
+
+bool Cpu::enable_jit() {
+    enable_block_cache();
+    return block_cache->enable_jit(*this);
 }
 
 auto Cpu::push(uint8_t data) -> void {
@@ -54,7 +179,7 @@ void Cpu::reset_V() {
 }
 
 void Cpu::reset_B() {
-    PS.B = 0;
+    PS.B = 0b11; // bits 4 and 5 have no storage and read as set, e.g. through PHP
 }
 
 void Cpu::reset_D() {
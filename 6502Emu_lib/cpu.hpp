@@ -3,25 +3,89 @@
 #define CPU6502
 #include "types.h"
 #include "mem.hpp"
+#include "block_cache.hpp"
+#include "profile.hpp"
+#include "scheduler.hpp"
 #include <array>
+#include <memory>
+
+#ifndef ENABLE_LAZY_FLAGS
+#define ENABLE_LAZY_FLAGS 1 // keep the last result for N and Z instead of computing both flags after every instruction
+#endif
+
+/// N flag that keeps the byte it was last computed from; bit 7 of it is only read when the flag is.
+/// Assigning a value behaves like assigning to a 1-bit field.
+struct LazySignFlag{
+    uint8_t source = 0;
+
+    operator uint8_t() const { return source >> 7; }
+    auto operator=(uint8_t bit) -> LazySignFlag& {
+        source = (bit & 1) << 7;
+        return *this;
+    }
+    /// N becomes bit 7 of `result`.
+    auto track(uint8_t result) -> void {
+        source = result;
+    }
+};
+
+/// Z flag that keeps the result it was last computed from; it is only compared with zero when the flag is read.
+/// Assigning a value behaves like assigning to a 1-bit field.
+struct LazyZeroFlag{
+    uint8_t source = 1;
+
+    operator uint8_t() const { return source == 0; }
+    auto operator=(uint8_t bit) -> LazyZeroFlag& {
+        source = !(bit & 1);
+        return *this;
+    }
+    /// Z becomes whether `result` is zero.
+    template<typename T>
+    auto track(T result) -> void {
+        if constexpr (sizeof(T) == 1)
+            source = result;
+        else
+            source = result != 0;
+    }
+};
 
 class Cpu{
     using size_t = std::size_t;
 public:
     static const unsigned int STACK_PTR_BASE = 0x0100; // lowest memory address of the SP, which ranges from 0x0100 - 0x01FF
+    static const uint16_t NMI_VECTOR = 0xFFFA;
+    static const uint16_t RESET_VECTOR = 0xFFFC;
+    static const uint16_t IRQ_VECTOR = 0xFFFE; // also used by BRK
     size_t frequency; // Frequency (Hz)
-    Mem memory; // Memory (0xFFFF bytes)
+    cycle_timestamp cycle_count; // Total cycles executed since power-on. While an instruction runs, the cycle it started at.
+    Mem memory; // Memory bus (64K address space, paged)
+    std::unique_ptr<BlockCache> block_cache; // Predecoded blocks used by the run loop. Null runs the plain interpreter.
+    std::unique_ptr<OpcodePairProfile> pair_profile; // Opcode-pair counts, recorded while set. Forces the plain interpreter.
+    Scheduler scheduler; // Device events. The run loop stops at each one's timestamp to fire it.
+    /// Cycle at which the current slice of the run loop ends; every interpreter core compares against it after each
+    /// instruction. A newly takeable interrupt sets it to 0, so it is taken after the running instruction.
+    cycle_timestamp slice_end = 0;
     uint8_t A, X, Y, SP; /// Accumulator, Index Register X, Index Register Y, Stack Pointer
     uint16_t PC; // Program Counter
     /// Processor Status (SIGN FLAG, OVERFLOW FLAG, B FLAG, DECIMAL MODE FLAG, INTERRUPT DISABLE FLAG, ZERO FLAG, CARRY FLAG)
     struct {
         uint8_t C : 1; // CARRY
+#if ENABLE_LAZY_FLAGS
+        uint8_t : 1; // ZERO is kept in `Z` below
+#else
         uint8_t Z : 1; // ZERO
+#endif
         uint8_t I : 1; // INTERRUPT DISABLE
         uint8_t D : 1; // DECIMAL
         uint8_t B : 2; // B
         uint8_t V : 1; // OVERFLOW
+#if ENABLE_LAZY_FLAGS
+        uint8_t : 1; // SIGN is kept in `N` below
+        LazyZeroFlag Z; // ZERO
+        LazySignFlag N; // SIGN
+#else
         uint8_t N : 1; // SIGN
+#endif
 
         auto conv() const -> uint8_t {
             return C | Z << 1 | I << 2 | D << 3 | B << 4 | V << 6 | N << 7;
@@ -67,20 +131,72 @@ public:
 
     /// Sends the RESET signal to the 6502
     auto reset() -> void {
-        PC = memory.get(0xFFFC) | (memory.get(0xFFFD) << 8);
+        PC = memory.get(RESET_VECTOR) | (memory.get(RESET_VECTOR + 1) << 8);
     }
 
+    // INTERRUPT LINES.
+
+    /// Drives the IRQ line on behalf of `source` (one bit per device). The line is level-triggered: it stays
+    /// asserted while any source holds it, and is taken between instructions whenever the I flag is clear.
+    void set_irq(bool asserted, uint32_t source = 1);
+    /// Drives the NMI line. It is edge-triggered: each rising edge latches one NMI, which is taken before an IRQ.
+    void set_nmi(bool asserted);
+    /// Whether an NMI or an unmasked IRQ will be taken before the next instruction.
+    auto interrupt_pending() const -> bool {
+        return nmi_pending || (irq_sources && !PS.I);
+    }
+    /// Ends the current slice if the I flag was just cleared while the IRQ line is held. Called by CLI, PLP and RTI.
+    auto irq_mask_changed() -> void {
+        if (irq_sources && !PS.I)
+            slice_end = 0;
+    }
+    /// Interrupt entry shared by BRK, IRQ and NMI: pushes PC and the status, sets I and jumps through `vector`.
+    /// The pushed status has bit 5 set, and the B bit (4) only for BRK.
+    void enter_interrupt(uint16_t vector, bool brk);
+
     Cpu(){
         frequency = 1660000; // DEFAULTS TO NES FREQUENCY
+        cycle_count = 0;
         reset_registers();
         reset_flags();
         memory.reset();
     }
+    // The block cache keeps a reference to `memory`, so a Cpu stays where it was constructed.
+    Cpu(const Cpu&) = delete;
+    Cpu& operator=(const Cpu&) = delete;
+
+    /// A new Cpu in the same state as this one. RAM is shared copy-on-write at page granularity, so forking costs
+    /// no copy of memory; each side copies a page the first time it writes to it (see `Mem::copied_pages`).
+    /// The fork starts without a block cache, pair profile, scheduled events or asserted interrupt lines.
+    std::unique_ptr<Cpu> fork();
 
     auto push(uint8_t data) -> void;
     auto pop() -> uint8_t;
 
-    void execute_instruction();
+    /// Executes a single instruction, or the entry sequence of a pending interrupt instead, then fires any events
+    /// that have become due. Returns the number of cycles taken.
+    cycles execute_instruction();
+    /// Executes whole instructions until at least `budget` cycles have elapsed.
+    /// Returns the number of cycles actually run, which can overshoot `budget` by part of an instruction.
+    cycles run_for(cycles budget);
+    /// Executes whole instructions until `cycle_count` reaches `timestamp`, firing scheduled events as their
+    /// timestamps are reached and taking interrupts between slices. Returns the new `cycle_count`.
+    cycle_timestamp run_until(cycle_timestamp timestamp);
+    /// Turns the predecoded block cache used by `run_for`/`run_until` on or off.
+    void enable_block_cache(bool enable = true);
+    /// Starts (or stops) counting opcode pairs into `pair_profile`. While counting, the run loop single-steps.
+    void enable_pair_profile(bool enable = true);
+    /// Turns on the block cache and native translation of hot blocks. Returns false if the host has no JIT,
+    /// in which case the block cache still runs interpreted.
+    bool enable_jit();
+    /// Emulated time since power-on, derived from `cycle_count` and `frequency`.
+    auto elapsed_seconds() const -> double {
+        return (double)cycle_count / frequency;
+    }
+    /// Number of cycles in `seconds` of emulated time, for scheduling events at a real-world rate.
+    auto cycles_in(double seconds) const -> cycle_timestamp {
+        return (cycle_timestamp)(seconds * frequency);
+    }
     void print_debug_info() const;
 
     template<size_t N>
@@ -90,6 +206,21 @@ public:
         }
     }
 
+private:
+    friend class BlockCache;
+
+    uint32_t irq_sources = 0; /// sources holding the IRQ line
+    bool nmi_line = false;
+    bool nmi_pending = false; /// latched by a rising edge of `nmi_line`
+
+    Cpu(Cpu& parent, Mem::Fork);
+    /// Takes the pending interrupt, NMI first. Returns its cycles.
+    cycles take_interrupt();
+    /// Fetches, decodes and runs the instruction at PC. Also used by the block cache for code it cannot decode ahead.
+    cycles step();
+    /// Runs CPU code alone until `timestamp`, or until `slice_end` is lowered, and returns the cycle count reached.
+    /// Does not fire events or take interrupts.
+    cycle_timestamp run_to(cycle_timestamp timestamp);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "device.hpp"
+
+Device::Device(Cpu& cpu) : cpu(cpu), synced(cpu.cycle_count){
+}
+
+Device::~Device(){
+    schedule(Scheduler::NEVER);
+    cpu.memory.unmap(first_page, page_count);
+}
+
+void Device::map_registers(std::size_t first, std::size_t count){
+    cpu.memory.unmap(first_page, page_count);
+    first_page = first;
+    page_count = count;
+    cpu.memory.map_io(first_page, page_count, on_read, on_write, this);
+}
+
+void Device::schedule(cycle_timestamp due){
+    if (event_pending)
+        cpu.scheduler.cancel(event);
+    event_pending = due != Scheduler::NEVER;
+    if (event_pending)
+        event = cpu.scheduler.schedule(due, on_due, this);
+}
+
+uint8_t Device::on_read(void* context, uint16_t addr){
+    auto* self = static_cast<Device*>(context);
+    self->sync();
+    return self->read(addr);
+}
+
+void Device::on_write(void* context, uint16_t addr, uint8_t value){
+    auto* self = static_cast<Device*>(context);
+    self->sync();
+    self->write(addr, value);
+}
+
+void Device::on_due(void* context, cycle_timestamp due){
+    auto* self = static_cast<Device*>(context);
+    self->event_pending = false;
+    self->catch_up(due);
+    self->on_event(due);
+}
@@ -0,0 +1,62 @@
+#ifndef DEVICE
+#define DEVICE
+#include "cpu.hpp"
+#include <cstddef>
+#include <cstdint>
+
+/** A peripheral emulated by catching up: it keeps the cycle it was last brought up to date and only runs forward
+ * when it has to, rather than being stepped along with every instruction.
+ *
+ * That happens when the CPU touches one of its registers (see `map_registers`) and when an event it scheduled with
+ * `schedule` fires. In both cases the device is first advanced to the current cycle, so it sees exactly the time
+ * that has passed. A device that nobody looks at costs nothing.
+ */
+class Device{
+public:
+    explicit Device(Cpu& cpu);
+    /// Unmaps the registers and cancels the pending event.
+    virtual ~Device();
+    Device(const Device&) = delete;
+    Device& operator=(const Device&) = delete;
+
+    /// Cycle the device has been brought up to.
+    cycle_timestamp synced_to() const { return synced; }
+    /// Runs the device forward to `timestamp`. Does nothing if it is already there.
+    void catch_up(cycle_timestamp timestamp){
+        if (timestamp > synced){
+            advance(synced, timestamp);
+            synced = timestamp;
+        }
+    }
+    /// Runs the device forward to the CPU's current cycle.
+    void sync(){ catch_up(cpu.cycle_count); }
+
+protected:
+    Cpu& cpu;
+
+    /// Runs the device's own logic for the cycles from `from` up to `to`.
+    virtual void advance(cycle_timestamp from, cycle_timestamp to) = 0;
+    /// Register access by the CPU, made after the device has caught up.
+    virtual uint8_t read(uint16_t addr) = 0;
+    virtual void write(uint16_t addr, uint8_t value) = 0;
+    /// Called when the event set with `schedule` is due, after catching up to `due`.
+    virtual void on_event(cycle_timestamp /*due*/){}
+
+    /// Routes `count` pages starting at `first_page` to `read` and `write`.
+    void map_registers(std::size_t first_page, std::size_t count);
+    /// Sets the device's next event, replacing any pending one. `Scheduler::NEVER` just cancels it.
+    void schedule(cycle_timestamp due);
+
+private:
+    cycle_timestamp synced;
+    std::size_t first_page = 0;
+    std::size_t page_count = 0;
+    bool event_pending = false;
+    Scheduler::event_id event = 0;
+
+    static uint8_t on_read(void* context, uint16_t addr);
+    static void on_write(void* context, uint16_t addr, uint8_t value);
+    static void on_due(void* context, cycle_timestamp due);
+};
+
+#endif
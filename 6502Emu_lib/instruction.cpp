@@ -1,5 +1,5 @@
 #include "instruction.hpp"
-#include <chrono>
+#include "bcd.hpp"
 #include <iostream>
 #include <bit>
 #include <fmt/format.h>
@@ -12,34 +12,35 @@ using namespace utils;
 
 /// BEGIN FLAG-SETTING MACROS
 
+#if ENABLE_LAZY_FLAGS
+#define CHECK_N_FLAG(val) cpu.PS.N.track(val)
+#define CHECK_Z_FLAG(val) cpu.PS.Z.track(val)
+#else
 #define CHECK_N_FLAG(val) cpu.PS.N = ((val) & 0x80) >> 7
 #define CHECK_Z_FLAG(val) cpu.PS.Z = !(val)
+#endif
 
 /// END FLAG-SETTING MACROS
 
 
-std::string Instruction::to_string() const {
-    #if ENABLE_INSTRUCTION_DEBUG_INFO
-    AddressingMode addr_mode = addrmode_mask(opcode);
-    std::string addr_mode_str = (std::string[]){
+std::string InstructionInfo::to_string() const {
+    static const char* const addr_mode_str[] = {
         "INDIRECT_X",
+        "Z_PAGE",
+        "IMM",
         "ACC",
         "ABS",
         "INDIRECT",
         "INDIRECT_Y",
-        "Z_PAGE",
+        "Z_PAGE_X",
+        "Z_PAGE_Y",
         "ABS_Y",
-        "ABS_X"
-    }[(int)addr_mode];
-    
-    return fmt::format("{} ({})", id, addr_mode_str);
-    #else
-    return "";
-    #endif
-}
+        "ABS_X",
+        "REL",
+        "IMPLIED"
+    };
 
-AddressingMode Instruction::addr_mode() const{
-    return addrmode_mask(opcode);
+    return fmt::format("{} ({})", id, addr_mode_str[mode]);
 }
 
 #define _D_FMT(args...) fmt::format("${:04X}: {} " args)
@@ -57,7 +58,7 @@ std::string DecompiledInstruction::to_string() const{
         case IMPLIED:
             return D_FMT("");
         case ABSOLUTE:
-            return D_FMT("${:04X}", ((uint16_t)raw[1]) | ((uint16_t)raw[2] << 4));
+            return D_FMT("${:04X}", ((uint16_t)raw[1]) | ((uint16_t)raw[2] << 8));
         case INDIRECT_Y:
             return D_FMT("(${:02X}),Y", raw[1]);
         case ZERO_PAGE_X:
@@ -65,9 +66,9 @@ std::string DecompiledInstruction::to_string() const{
         case ZERO_PAGE_Y:
             return D_FMT("${:02X},Y", raw[1]);
         case ABSOLUTE_X:
-            return D_FMT("${:04X},X", ((uint16_t)raw[1]) | ((uint16_t)raw[2] << 4));
+            return D_FMT("${:04X},X", ((uint16_t)raw[1]) | ((uint16_t)raw[2] << 8));
         case ABSOLUTE_Y:
-            return D_FMT("${:04X},Y", ((uint16_t)raw[1]) | ((uint16_t)raw[2] << 4));
+            return D_FMT("${:04X},Y", ((uint16_t)raw[1]) | ((uint16_t)raw[2] << 8));
         case RELATIVE:
             return D_FMT("[${:04X}]", addr + std::bit_cast<int8_t, uint8_t>(raw[1]));
         default:
@@ -76,7 +77,7 @@ std::string DecompiledInstruction::to_string() const{
     }
 }
 
-DecompiledInstruction::DecompiledInstruction(InstructionTable const& table, Mem const& memory, std::size_t addr){
+DecompiledInstruction::DecompiledInstruction(InstructionInfoTable const& table, Mem const& memory, std::size_t addr){
     this->addr = addr;
     instruction = table.get(memory.get(addr));
     raw[0] = memory.get(addr);
@@ -99,42 +100,44 @@ DecompiledInstruction::DecompiledInstruction(InstructionTable const& table, Mem
             break;
         default:
             fmt::print(fmt::emphasis::bold | fmt::emphasis::italic | fmt::fg(fmt::color::red), 
-                "DecompiledInstruction Instatiation Error: Invalid instruction mode {} from {} at address {}\n", instruction.mode, instruction.id, addr);
+                "DecompiledInstruction Instatiation Error: Invalid instruction mode {} from {} at address {}\n", (int)instruction.mode, instruction.id, addr);
             abort();
     }
 }
 
+/// Result of a decimal-mode ADC/SBC of `data` into the accumulator. Looks it up when ENABLE_BCD_TABLES is set,
+/// except for the 16-bit operands (zp),Y produces, which the tables do not cover.
+template<bcd::Result (*Operation)(uint8_t, uint16_t, bool)>
+static bcd::Result decimal_result(const Cpu& cpu, uint16_t data){
+    #if ENABLE_BCD_TABLES
+    const bcd::Table& table = Operation == bcd::adc ? bcd::adc_table : bcd::sbc_table;
+    if (data <= 0xFF)
+        return bcd::lookup(table, cpu.A, data, cpu.PS.C);
+    #endif
+    return Operation(cpu.A, data, cpu.PS.C);
+}
+
+static void set_decimal_result(Cpu& cpu, bcd::Result result){
+    cpu.A = result.value;
+    cpu.PS.N = (result.flags & bcd::N) != 0;
+    cpu.PS.V = (result.flags & bcd::V) != 0;
+    cpu.PS.Z = (result.flags & bcd::Z) != 0;
+    cpu.PS.C = (result.flags & bcd::C) != 0;
+}
+
 /// ADC (Add with carry)
 template<AddressingMode mode>
-static cycles instructions::ADC(Cpu& cpu){
+static cycles instructions::ADC(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<mode, 8>({IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},{2,3,4,4,4,4,6,5});
-    auto data = load_addr<mode, NORMAL_MODE>(cpu);
+    auto data = load_addr<mode, NORMAL_MODE>(cpu, op);
 
     if (cpu.PS.D) { // BCD
-        uint8_t lower = (uint8_t)(data.first & 0x0F) + (cpu.A & 0x0F) + cpu.PS.C;
-        if (lower > 0x9) lower += 6;
-
-        uint8_t upper = (uint8_t)(data.first >> 4) + (cpu.A >> 4) + (lower > 0x0F);
-        if (upper > 0x9) upper += 6;
-       
-        uint8_t h1 = cpu.A >> 4;
-        uint8_t h2 = (uint8_t)data.first >> 4;
-        uint8_t s1 = (h1 & 0x8) ? h1 - 0x0F : h1;
-        uint8_t s2 = (h2 & 0x8) ? h2 - 0x0F : h2;
-        int8_t s = std::bit_cast<int8_t, uint8_t>(s1+s2);
-        
-        cpu.PS.N = cpu.PS.V = cpu.PS.Z = cpu.PS.C = 0;
-        cpu.PS.V = (s < -8 || s > 7);
-        cpu.PS.C = (upper > 0xF);
-        cpu.A = (upper << 4) | (lower & 0xF);
-        cpu.PS.Z = (cpu.A == 0);
-        cpu.PS.N = (upper >> 3);
-        
+        set_decimal_result(cpu, decimal_result<bcd::adc>(cpu, data.first));
     } else {
         uint16_t result = (uint16_t)cpu.A + (uint16_t)data.first + (uint16_t)cpu.PS.C;
         cpu.PS.C = result > 255;
-        cpu.PS.N = (result & 0x80) > 0;
-        cpu.PS.Z = (result & 0xFF) == 0;
+        CHECK_N_FLAG((uint8_t)result);
+        CHECK_Z_FLAG((uint8_t)result);
         cpu.PS.V = ((~((uint16_t)cpu.A ^ (uint16_t)data.first)) & ((uint16_t)cpu.A ^ (result)) & 0x80) > 0;
         cpu.A = (uint8_t)(result & 0xFF);
     }
@@ -144,9 +147,9 @@ static cycles instructions::ADC(Cpu& cpu){
 
 /// AND (logical AND)
 template<AddressingMode Mode>
-static cycles instructions::AND(Cpu& cpu){
+static cycles instructions::AND(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y}, {2, 3, 4, 4, 4, 4, 6, 5});
-    auto data = load_addr<Mode, NORMAL_MODE>(cpu);
+    auto data = load_addr<Mode, NORMAL_MODE>(cpu, op);
     cpu.A &= data.first;
     CHECK_Z_FLAG(cpu.A);
     CHECK_N_FLAG(cpu.A);
@@ -155,17 +158,17 @@ static cycles instructions::AND(Cpu& cpu){
 
 /// ASL (Arithmetic Shift Left)
 template<AddressingMode Mode>
-static cycles instructions::ASL(Cpu& cpu){
+static cycles instructions::ASL(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({ACCUMULATOR, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X}, {2, 5, 6, 6, 7});
     std::pair<uint16_t, bool> data;
     uint16_t tmp;
-    if (contains_modes<ACCUMULATOR>(Mode)){
+    if constexpr (contains_modes<ACCUMULATOR>(Mode)){
         //cpu.PS.C = cpu.A & 0x80;
         tmp = cpu.A << 1;
         cpu.A = tmp;
         //cpu.PS.N = cpu.A & 0x80;
     } else {
-        data = load_addr_ref<Mode, NORMAL_MODE>(cpu);
+        data = load_addr_ref<Mode, NORMAL_MODE>(cpu, op);
         tmp = cpu.memory.get(data.first);
         cpu.memory.set(data.first, tmp << 1);
     }
@@ -177,8 +180,8 @@ static cycles instructions::ASL(Cpu& cpu){
 
 /// BRANCH (Generic function for all relative branching in the 6502)
 template<PSFlagType Flag, bool IsSet>
-static cycles instructions::BRANCH(Cpu& cpu){
-    int8_t data = std::bit_cast<int8_t, uint8_t>(cpu.memory.get(cpu.PC++));
+static cycles instructions::BRANCH(Cpu& cpu, operands op){
+    int8_t data = std::bit_cast<int8_t, uint8_t>((uint8_t)op);
     uint16_t branch_location = (uint16_t)((int16_t)cpu.PC + (int16_t)data);
     if (is_flag<Flag, IsSet>(cpu)){
         if ((branch_location & 0xFF00) ^ (cpu.PC & 0xFF00)){ // Check if to a new page.
@@ -195,9 +198,9 @@ static cycles instructions::BRANCH(Cpu& cpu){
 
 /// BIT (Bit Test)
 template<AddressingMode Mode>
-static cycles instructions::BIT(Cpu &cpu){
+static cycles instructions::BIT(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({ZERO_PAGE, ABSOLUTE}, {3, 4});
-    std::pair<uint16_t, bool> data = load_addr<Mode, NORMAL_MODE>(cpu);
+    std::pair<uint16_t, bool> data = load_addr<Mode, NORMAL_MODE>(cpu, op);
     uint8_t value = cpu.A & data.first;
 
     CHECK_Z_FLAG(value);
@@ -207,30 +210,27 @@ static cycles instructions::BIT(Cpu &cpu){
 }
 
 /// BRK (Force Interrupt)
-static cycles instructions::BRK(Cpu &cpu){
+static cycles instructions::BRK(Cpu& cpu, operands op){
     constexpr cycles cyc = 7;
-    cpu.PC++; // has an extra padding byte.
-    cpu.PS.B = 0b11;
-    uint8_t flags = cpu.PS.conv();
-    cpu.push(cpu.PC >> 8);
-    cpu.push(cpu.PC & 0x00FF);
-    cpu.push(flags);
-    cpu.PC = cpu.memory.get(0xFFFE) | (cpu.memory.get(0xFFFF) << 8);
+    cpu.PC++; // has an extra padding byte, which is not part of the decoded instruction.
+    cpu.enter_interrupt(Cpu::IRQ_VECTOR, true);
     return cyc;
 }
 
 template<PSFlagType Flag, bool Value>
-static cycles instructions::FLAGSET(Cpu& cpu){
+static cycles instructions::FLAGSET(Cpu& cpu, operands op){
     constexpr cycles cyc = 2;
     set_flag<Flag,Value>(cpu);
+    if constexpr (Flag == INTERRUPT_DISABLE_FLAG && !Value)
+        cpu.irq_mask_changed();
     return cyc;
 }
 
 template<AddressingMode Mode>
-static cycles instructions::CMP(Cpu& cpu){
+static cycles instructions::CMP(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
                                             {2,3,4,4,4,4,6,5});
-    auto data = load_addr<Mode, NORMAL_MODE>(cpu);
+    auto data = load_addr<Mode, NORMAL_MODE>(cpu, op);
     cpu.PS.N = ((cpu.A - data.first) & 0x80) > 0;
     cpu.PS.Z = (cpu.A == data.first);
     cpu.PS.C = (cpu.A >= data.first);
@@ -238,9 +238,9 @@ static cycles instructions::CMP(Cpu& cpu){
 }
 
 template<AddressingMode Mode, bool IsX>
-static cycles instructions::CMP_REG(Cpu& cpu){
+static cycles instructions::CMP_REG(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({IMMEDIATE, ZERO_PAGE, ABSOLUTE}, {2,3,4});
-    auto data = load_addr<Mode, NORMAL_MODE>(cpu);
+    auto data = load_addr<Mode, NORMAL_MODE>(cpu, op);
     if (IsX) {
         cpu.PS.N = ((cpu.X - data.first) & 0x80) > 0;
         cpu.PS.Z = (cpu.X == data.first);
@@ -254,9 +254,9 @@ static cycles instructions::CMP_REG(Cpu& cpu){
 }
 
 template<AddressingMode Mode, bool IsIncrement>
-static cycles instructions::INCDEC_MEMORY(Cpu& cpu){
+static cycles instructions::INCDEC_MEMORY(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X}, {5,6,6,7});
-    auto data = load_addr_ref<Mode, NORMAL_MODE>(cpu);
+    auto data = load_addr_ref<Mode, NORMAL_MODE>(cpu, op);
     uint8_t result = IsIncrement ?  cpu.memory.get(data.first)+1 : cpu.memory.get(data.first)-1;
     CHECK_Z_FLAG(result);
     CHECK_N_FLAG(result);
@@ -265,7 +265,7 @@ static cycles instructions::INCDEC_MEMORY(Cpu& cpu){
 }
 
 template<bool IsX, bool IsIncrement>
-static cycles instructions::INCDEC_REG(Cpu& cpu){
+static cycles instructions::INCDEC_REG(Cpu& cpu, operands op){
     constexpr cycles cyc = 2;
     uint8_t result;
     if (IsX)
@@ -279,10 +279,10 @@ static cycles instructions::INCDEC_REG(Cpu& cpu){
 
 /// EOR (Exclusive OR)
 template<AddressingMode Mode>
-static cycles instructions::EOR(Cpu& cpu){
+static cycles instructions::EOR(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
                                             {2,3,4,4,4,4,6,5});
-    auto data = load_addr<Mode, NORMAL_MODE>(cpu);
+    auto data = load_addr<Mode, NORMAL_MODE>(cpu, op);
     cpu.A ^= data.first;
     CHECK_Z_FLAG(cpu.A);
     CHECK_N_FLAG(cpu.A);
@@ -291,17 +291,17 @@ static cycles instructions::EOR(Cpu& cpu){
 
 /// JMP (Jump)
 template<AddressingMode AMode, ModeType MMode>
-static cycles instructions::JMP(Cpu& cpu){
-    auto data = load_addr_ref<AMode, MMode>(cpu);
+static cycles instructions::JMP(Cpu& cpu, operands op){
+    auto data = load_addr_ref<AMode, MMode>(cpu, op);
     cpu.PC = data.first;
     return (MMode == NORMAL_MODE) ? 3 : 5;
 }
 
 /// JSR (Jump to Subroutine)
 template<AddressingMode Mode>
-static cycles instructions::JSR(Cpu& cpu){
+static cycles instructions::JSR(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({ABSOLUTE}, {6}); // Done to ensure only ABSOLUTE is used in this instruction
-    auto data = load_addr<Mode, NORMAL_MODE>(cpu);
+    auto data = load_addr<Mode, NORMAL_MODE>(cpu, op);
     cpu.push(cpu.PC >> 8);
     cpu.push((cpu.PC & 0x00FF) - 1);
     cpu.PC = data.first;
@@ -309,10 +309,10 @@ static cycles instructions::JSR(Cpu& cpu){
 }
 
 template<AddressingMode Mode>
-static cycles instructions::LDA(Cpu& cpu){
+static cycles instructions::LDA(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
                                             {2,3,4,4,4,4,6,5});
-    auto data = load_addr<Mode, NORMAL_MODE>(cpu);
+    auto data = load_addr<Mode, NORMAL_MODE>(cpu, op);
     cpu.A = data.first;
     CHECK_Z_FLAG(cpu.A);
     CHECK_N_FLAG(cpu.A);
@@ -320,9 +320,9 @@ static cycles instructions::LDA(Cpu& cpu){
 }
 
 template<AddressingMode Mode, bool IsX, ModeType MMode>
-static cycles instructions::LOAD_REG(Cpu& cpu){
+static cycles instructions::LOAD_REG(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ZERO_PAGE_Y, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y}, {2,3,4,4,4,4,4});
-    auto data = load_addr<Mode, MMode>(cpu);
+    auto data = load_addr<Mode, MMode>(cpu, op);
     uint8_t result;
     if (IsX){ // X Register
         result = (cpu.X = data.first);
@@ -335,10 +335,10 @@ static cycles instructions::LOAD_REG(Cpu& cpu){
 }
 
 template<AddressingMode Mode, Bitshift::Enum ShiftType>
-static cycles instructions::BITSHIFT(Cpu& cpu){
+static cycles instructions::BITSHIFT(Cpu& cpu, operands op){
     uint16_t tmp;
     constexpr cycles cyc = get_cycles<Mode>({ACCUMULATOR, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X}, {2,5,6,6,7});
-    if (contains_modes<ACCUMULATOR>(Mode)){
+    if constexpr (contains_modes<ACCUMULATOR>(Mode)){
         switch (ShiftType){
             case Bitshift::ROTATE_LEFT:
                 tmp = (cpu.A << 1) | cpu.PS.C;
@@ -359,45 +359,46 @@ static cycles instructions::BITSHIFT(Cpu& cpu){
         if (!cpu.A) cpu.PS.Z = 1;
         if (cpu.A & 0x80) cpu.PS.N = 1;
         return cyc;
-    }
-    auto data = load_addr_ref<Mode, NORMAL_MODE>(cpu);
-    cpu.PS.C = data.first & 1;
-    uint8_t value = cpu.memory.get(data.first);
-    switch (ShiftType){
-        case Bitshift::ROTATE_LEFT:
-            tmp = (value << 1) | cpu.PS.C;
-            cpu.PS.C = tmp & 0x100;
-            value = tmp & 0xFF;
-            break;
-        case Bitshift::ROTATE_RIGHT:
-            tmp = (cpu.PS.C << 7) | (value >> 1);
-            cpu.PS.C = value & 0x01;
-            value = tmp & 0xFF;
-            break;
-        case Bitshift::SHIFT_RIGHT:
-            cpu.PS.C = value & 1;
-            cpu.PS.N = 0;
-            value >>= 1;
-            break;
-    }
+    } else {
+        auto data = load_addr_ref<Mode, NORMAL_MODE>(cpu, op);
+        cpu.PS.C = data.first & 1;
+        uint8_t value = cpu.memory.get(data.first);
+        switch (ShiftType){
+            case Bitshift::ROTATE_LEFT:
+                tmp = (value << 1) | cpu.PS.C;
+                cpu.PS.C = tmp & 0x100;
+                value = tmp & 0xFF;
+                break;
+            case Bitshift::ROTATE_RIGHT:
+                tmp = (cpu.PS.C << 7) | (value >> 1);
+                cpu.PS.C = value & 0x01;
+                value = tmp & 0xFF;
+                break;
+            case Bitshift::SHIFT_RIGHT:
+                cpu.PS.C = value & 1;
+                cpu.PS.N = 0;
+                value >>= 1;
+                break;
+        }
 
-    if (!value) cpu.PS.Z = 1;
-    if (value & 0x80) cpu.PS.N = 1;
-    return cyc;
+        if (!value) cpu.PS.Z = 1;
+        if (value & 0x80) cpu.PS.N = 1;
+        return cyc;
+    }
 }
 
 /// NOP (No Operation)
-static cycles instructions::NOP(Cpu& cpu){
+static cycles instructions::NOP(Cpu& cpu, operands op){
     constexpr cycles cyc = 2; // IMPLIED
     return cyc;
 }
 
 /// ORA (Logical Inclusive OR)
 template<AddressingMode Mode>
-static cycles instructions::ORA(Cpu& cpu){
+static cycles instructions::ORA(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
                                             {2,3,4,4,4,4,6,5});
-    auto data = load_addr<Mode, NORMAL_MODE>(cpu);
+    auto data = load_addr<Mode, NORMAL_MODE>(cpu, op);
     cpu.A |= data.first;
     CHECK_N_FLAG(cpu.A);
     CHECK_Z_FLAG(cpu.A);
@@ -405,18 +406,18 @@ static cycles instructions::ORA(Cpu& cpu){
 }
 
 template<bool IsAcc>
-static cycles instructions::PUSH_REG(Cpu& cpu){
+static cycles instructions::PUSH_REG(Cpu& cpu, operands op){
     constexpr cycles cyc = 3; // IMPLIED
     if (IsAcc)
         cpu.push(cpu.A);
     else
-        cpu.push(cpu.PS.conv());
+        cpu.push(cpu.PS.conv() | 0x30); // B is pushed set, as by BRK
     return cyc;
 }
 
 
 template<bool IsAcc>
-static cycles instructions::PULL_REG(Cpu& cpu){
+static cycles instructions::PULL_REG(Cpu& cpu, operands op){
     constexpr cycles cyc = 4; // IMPLIED
     uint8_t result = cpu.pop();
     if (IsAcc){
@@ -425,20 +426,22 @@ static cycles instructions::PULL_REG(Cpu& cpu){
         CHECK_Z_FLAG(cpu.A);
     } else {
         cpu.PS.set(result);
+        cpu.irq_mask_changed();
     }
     return cyc;
 }
 
 /// RTI (Return from Interrupt)
-static cycles instructions::RTI(Cpu& cpu){
+static cycles instructions::RTI(Cpu& cpu, operands op){
     constexpr cycles cyc = 6; // IMPLIED
     cpu.PS.set(cpu.pop());
     cpu.PC = cpu.pop() | (cpu.pop() << 8);
+    cpu.irq_mask_changed();
     return cyc;
 }
 
 /// RTS (Return from Subroutine)
-static cycles instructions::RTS(Cpu& cpu){
+static cycles instructions::RTS(Cpu& cpu, operands op){
     constexpr cycles cyc = 6; // IMPLIED
     cpu.PC = cpu.pop() | (cpu.pop() << 8);
     cpu.PC += 1;
@@ -447,32 +450,18 @@ static cycles instructions::RTS(Cpu& cpu){
 
 /// SBC (Subtract with Carry)
 template<AddressingMode Mode>
-static cycles instructions::SBC(Cpu& cpu){
+static cycles instructions::SBC(Cpu& cpu, operands op){
     constexpr cycles cyc = get_cycles<Mode>({IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
                                             {2,3,4,4,4,4,6,5});
-    auto data = load_addr<Mode, NORMAL_MODE>(cpu);
+    auto data = load_addr<Mode, NORMAL_MODE>(cpu, op);
 
     if (cpu.PS.D) { // BCD
-        uint16_t result = cpu.A - data.first - !cpu.PS.C;
-        // split upper and lower into separate bytes for calculation.
-        uint8_t lower = (cpu.A & 0x0F) - (data.first & 0x0F) - !cpu.PS.C;
-        if (lower & 0x80) lower -= 6; // 0x80 - 0x6 = 0xA (make lower digit wrap between 0x0 and 0x9)
-
-        uint8_t upper = (cpu.A >> 4) - (data.first >> 4) - (lower >> 7); // subtract 1 if lower digit overflowed
-        if (upper & 0x80) upper -=6; // 0x80 - 0x6 = 0xA (make lower digit wrap between 0x0 and 0x9)
-
-        cpu.PS.N = cpu.PS.V = cpu.PS.Z = cpu.PS.C = 0;
-        cpu.PS.V = (((uint16_t)cpu.A ^ data.first) & ((uint16_t)cpu.A ^ result) & 0x80) > 0;
-        cpu.PS.C = ((result & 0xFF00) == 0);
-        cpu.A = (upper << 4) | (lower & 0xF);
-        cpu.PS.Z = (cpu.A == 0);
-        cpu.PS.N = (upper >> 7);
-
+        set_decimal_result(cpu, decimal_result<bcd::sbc>(cpu, data.first));
     } else {
         uint16_t result = (uint16_t)cpu.A + ((uint16_t)(data.first) ^ 0x00FF) + (uint16_t)cpu.PS.C;
         cpu.PS.C = result > 0xFF;
-        cpu.PS.N = (result & 0x80) > 0;
-        cpu.PS.Z = (result & 0xFF) == 0;
+        CHECK_N_FLAG((uint8_t)result);
+        CHECK_Z_FLAG((uint8_t)result);
         cpu.PS.V = ((~((uint16_t)cpu.A ^ (uint16_t)(~data.first))) & ((uint16_t)cpu.A ^ (result)) & 0x80) > 0;
         cpu.A = (uint8_t)(result & 0xFF);
     }
@@ -481,236 +470,216 @@ static cycles instructions::SBC(Cpu& cpu){
 }
 
 
-template<AddressingMode Mode, Register::Enum Reg>
-static cycles instructions::STORE_REG(Cpu& cpu){
+template<AddressingMode Mode, Register::Enum Reg, ModeType MMode>
+static cycles instructions::STORE_REG(Cpu& cpu, operands op){
+    static_assert(Reg != Register::SP, "Invalid Register type in STORE_REG template parameter `Reg`.");
     constexpr cycles cyc = get_cycles<Mode>({ZERO_PAGE, ZERO_PAGE_X, ZERO_PAGE_Y, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y}, {3,4,4,4,5,5,6,6});
-    auto data = load_addr_ref<Mode, NORMAL_MODE>(cpu);
-    switch (Reg){
-        case Register::A:
-            cpu.memory.set(data.first, cpu.A);
-            break;
-        case Register::X:
-            cpu.memory.set(data.first, cpu.X);
-            break;
-        case Register::Y:
-            cpu.memory.set(data.first, cpu.Y);
-            break;
-        default:
-            throw std::runtime_error("Invalid Register type in STORE_REG template parameter `Reg`.");
-    }
+    auto data = load_addr_ref<Mode, MMode>(cpu, op);
+    cpu.memory.set(data.first, register_ref<Reg>(cpu));
     return cyc;
 }
 
 template<Register::Enum FromReg, Register::Enum ToReg>
-static cycles instructions::TRANSFER_REG(Cpu& cpu){
-    static const char error_words[] = "Invalid Register type in TRANSFER_REF template parameter `ToReg`.";
+static cycles instructions::TRANSFER_REG(Cpu& cpu, operands op){
+    static_assert((FromReg == Register::A && (ToReg == Register::X || ToReg == Register::Y)) // TAX, TAY
+                  || (FromReg == Register::X && (ToReg == Register::A || ToReg == Register::SP)) // TXA, TXS
+                  || (FromReg == Register::Y && ToReg == Register::A) // TYA
+                  || (FromReg == Register::SP && ToReg == Register::X), // TSX
+                  "Invalid Register pair in TRANSFER_REG template parameters.");
     constexpr cycles cyc = 2;
-    switch (FromReg) {
-        case Register::A:
-            switch (ToReg){
-                case Register::X:
-                    cpu.X = cpu.A;
-                    CHECK_Z_FLAG(cpu.X);
-                    CHECK_N_FLAG(cpu.X);
-                    break;
-                case Register::Y:
-                    cpu.Y = cpu.A;
-                    CHECK_Z_FLAG(cpu.Y);
-                    CHECK_N_FLAG(cpu.Y);
-                    break;
-                default:
-                    throw std::runtime_error(error_words);
-            }
-            break;
-        case Register::X:
-            switch (ToReg){
-                case Register::A:
-                    cpu.A = cpu.X;
-                    CHECK_Z_FLAG(cpu.A);
-                    CHECK_N_FLAG(cpu.A);
-                    break;
-                case Register::SP:
-                    cpu.SP = cpu.X;
-                    break;
-                default:
-                    throw std::runtime_error(error_words);
-            }
-            break;
-        case Register::Y:
-            if (ToReg == Register::A)
-                cpu.A = cpu.Y;
-            else
-                throw std::runtime_error(error_words);
-            CHECK_Z_FLAG(cpu.A);
-            CHECK_N_FLAG(cpu.A);
-            break;
-        case Register::SP:
-            if (ToReg == Register::X)
-                cpu.X = cpu.SP;
-            else
-                throw std::runtime_error(error_words);
-            CHECK_Z_FLAG(cpu.X);
-            CHECK_N_FLAG(cpu.X);
-            break;
+    uint8_t value = register_ref<FromReg>(cpu);
+    register_ref<ToReg>(cpu) = value;
+    if constexpr (ToReg != Register::SP){ // TXS leaves the flags alone
+        CHECK_Z_FLAG(value);
+        CHECK_N_FLAG(value);
     }
     return cyc;
 }
 
-#define CREATE_INSTRUCTION(opcode, innies...) table[opcode] = Instruction(innies)
+/// Entry used for every opcode that has no implementation.
+/// Charges the minimum instruction time so that the run loop always makes progress.
+static cycles invalid_instr(Cpu& cpu, operands op){
+    std::cerr << "INVALID INSTRUCTION AT " << std::hex << (int)cpu.PC << "\n";
+    return 2;
+}
 
-InstructionTable::InstructionTable(){
+/// Compile-time builder for the hot `instruction_table` and the cold `instruction_info`.
+/// Both are filled from the same listing below and then copied out as two separate objects.
+struct InstructionTableBuilder{
+    InstructionTable hot{};
+    InstructionInfoTable cold{};
+    uint8_t handler_count = 0;
+
+    template<int N>
+    constexpr auto create_instructions(const int (&codes)[N], const instruction_function<Cpu&> (&funcs)[N], const AddressingMode (&addr_modes)[N],
+                                       const cycles (&base_cycles)[N], const char* name){
+        for (int i = 0; i < N; i++){
+            hot.handlers[handler_count] = funcs[i];
+            hot.table[codes[i]] = Instruction{handler_count++, (uint8_t)base_cycles[i], utils::instruction_length(addr_modes[i])};
+            cold.table[codes[i]] = InstructionInfo{name, (uint8_t)codes[i], addr_modes[i], utils::instruction_length(addr_modes[i])};
+        }
+    }
+
+    constexpr InstructionTableBuilder();
+};
+
+constexpr InstructionTableBuilder::InstructionTableBuilder(){
     using namespace instructions;
-    auto time_begin = std::chrono::steady_clock::now();
 
-    static auto invalid_instr = [](Cpu& cpu)->cycles{
-        std::cerr << "INVALID INSTRUCTION AT " << std::hex << (int)cpu.PC << "\n";
-        return 0;
-    };
-    
-    for (auto& entry : table) {
-        #if ENABLE_INSTRUCTION_DEBUG_INFO
-        entry = Instruction(invalid_instr, "???", 0xFF, ACCUMULATOR);
-        #else
-        entry = Instruction(invalid_instr);
-        #endif
-    }
+    // Handler 0 is the invalid instruction, which every entry starts out pointing to.
+    hot.handlers[handler_count++] = invalid_instr;
+    for (auto& entry : hot.table)
+        entry.base_cycles = 2;
 
     /// ADC
     create_instructions(
             {0x69, 0x65, 0x75, 0x6D, 0x7D, 0x79, 0x61, 0x71},
             {ADC<IMMEDIATE>, ADC<ZERO_PAGE>, ADC<ZERO_PAGE_X>, ADC<ABSOLUTE>, ADC<ABSOLUTE_X>, ADC<ABSOLUTE_Y>, ADC<INDIRECT_X>, ADC<INDIRECT_Y>},
             {IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
+            {2, 3, 4, 4, 4, 4, 6, 5},
             "ADC");
     /// AND
     create_instructions({0x29, 0x25, 0x35, 0x2D, 0x3D, 0x39, 0x21, 0x31},
                            {AND<IMMEDIATE>, AND<ZERO_PAGE>, AND<ZERO_PAGE_X>, AND<ABSOLUTE>, AND<ABSOLUTE_X>, AND<ABSOLUTE_Y>, AND<INDIRECT_X>, AND<INDIRECT_Y>},
                            {IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
+                           {2, 3, 4, 4, 4, 4, 6, 5},
                            "AND");
     /// ASL
     create_instructions({0x0A, 0x06, 0x16, 0x0E, 0x1E},
                         {ASL<ACCUMULATOR>, ASL<ZERO_PAGE>, ASL<ZERO_PAGE_X>, ASL<ABSOLUTE>, ASL<ABSOLUTE_X>},
                         {ACCUMULATOR, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X},
+                        {2, 5, 6, 6, 7},
                         "ASL");
 
     
     /// BCC
     //CREATE_INSTRUCTION(0x90, BRANCH<CARRY_FLAG, false>, "BCC");
-    create_instructions({0x90}, {BRANCH<CARRY_FLAG, false>}, {RELATIVE}, "BCC");
+    create_instructions({0x90}, {BRANCH<CARRY_FLAG, false>}, {RELATIVE}, {2}, "BCC");
 
     /// BCS
     //CREATE_INSTRUCTION(0xB0, BRANCH<CARRY_FLAG, true>, "BCS");
-    create_instructions({0xB0}, {BRANCH<CARRY_FLAG, true>}, {RELATIVE}, "BCS");
+    create_instructions({0xB0}, {BRANCH<CARRY_FLAG, true>}, {RELATIVE}, {2}, "BCS");
 
     /// BEQ
     //CREATE_INSTRUCTION(0xF0, BRANCH<ZERO_FLAG, true>, "BEQ");
-    create_instructions({0xF0}, {BRANCH<ZERO_FLAG, true>}, {RELATIVE}, "BEQ");
+    create_instructions({0xF0}, {BRANCH<ZERO_FLAG, true>}, {RELATIVE}, {2}, "BEQ");
 
     /// BIT
-    create_instructions({0x24, 0x2C}, {BIT<ZERO_PAGE>, BIT<ABSOLUTE>}, {ZERO_PAGE, ABSOLUTE}, "BIT");
+    create_instructions({0x24, 0x2C}, {BIT<ZERO_PAGE>, BIT<ABSOLUTE>}, {ZERO_PAGE, ABSOLUTE}, {3, 4}, "BIT");
 
     /// BMI
-    create_instructions({0x30}, {BRANCH<NEGATIVE_FLAG, true>}, {RELATIVE}, "BMI");
+    create_instructions({0x30}, {BRANCH<NEGATIVE_FLAG, true>}, {RELATIVE}, {2}, "BMI");
 
     /// BNE
-    create_instructions({0xD0}, {BRANCH<ZERO_FLAG, false>}, {RELATIVE}, "BNE");
+    create_instructions({0xD0}, {BRANCH<ZERO_FLAG, false>}, {RELATIVE}, {2}, "BNE");
 
     /// BPL
-    create_instructions({0x10}, {BRANCH<NEGATIVE_FLAG, false>}, {RELATIVE}, "BPL");
+    create_instructions({0x10}, {BRANCH<NEGATIVE_FLAG, false>}, {RELATIVE}, {2}, "BPL");
 
     /// BRK
-    create_instructions({0x00}, {BRK}, {IMPLIED}, "BRK");
+    create_instructions({0x00}, {BRK}, {IMPLIED}, {7}, "BRK");
 
     /// BVC (Branch if Overflow Clear)
-    create_instructions({0x50}, {BRANCH<OVERFLOW_FLAG, false>}, {RELATIVE}, "BVC");
+    create_instructions({0x50}, {BRANCH<OVERFLOW_FLAG, false>}, {RELATIVE}, {2}, "BVC");
 
     /// BVS (Branch if Overflow Set)
-    create_instructions({0x70}, {BRANCH<OVERFLOW_FLAG, true>}, {RELATIVE}, "BVS");
+    create_instructions({0x70}, {BRANCH<OVERFLOW_FLAG, true>}, {RELATIVE}, {2}, "BVS");
 
     /// CLC (Clear Carry Flag)
-    create_instructions({0x18}, {FLAGSET<CARRY_FLAG, false>}, {IMPLIED}, "CLC");
+    create_instructions({0x18}, {FLAGSET<CARRY_FLAG, false>}, {IMPLIED}, {2}, "CLC");
 
     /// CLD (Clear Decimal Mode)
-    create_instructions({0xD8}, {FLAGSET<DECIMAL_FLAG, false>}, {IMPLIED}, "CLD");
+    create_instructions({0xD8}, {FLAGSET<DECIMAL_FLAG, false>}, {IMPLIED}, {2}, "CLD");
 
     /// CLI (Clear Interrupt Disable)
-    create_instructions({0x58}, {FLAGSET<INTERRUPT_DISABLE_FLAG, false>}, {IMPLIED}, "CLI");
+    create_instructions({0x58}, {FLAGSET<INTERRUPT_DISABLE_FLAG, false>}, {IMPLIED}, {2}, "CLI");
 
     /// CLV (Clear Overflow Flag)
-    create_instructions({0xB8}, {FLAGSET<OVERFLOW_FLAG, false>}, {IMPLIED}, "CLV");
+    create_instructions({0xB8}, {FLAGSET<OVERFLOW_FLAG, false>}, {IMPLIED}, {2}, "CLV");
 
     /// CMP (Compare Accumulator)
     create_instructions({0xC9, 0xC5, 0xD5, 0xCD, 0xDD, 0xD9, 0xC1, 0xD1},
                         {CMP<IMMEDIATE>, CMP<ZERO_PAGE>, CMP<ZERO_PAGE_X>, CMP<ABSOLUTE>, CMP<ABSOLUTE_X>, CMP<ABSOLUTE_Y>, CMP<INDIRECT_X>, CMP<INDIRECT_Y>},
                         {IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
+                        {2, 3, 4, 4, 4, 4, 6, 5},
                         "CMP");
 
     /// CPX (Compare X Register)
     create_instructions({0xE0, 0xE4, 0xEC}, 
                         {CMP_REG<IMMEDIATE, true>, CMP_REG<ZERO_PAGE, true>, CMP_REG<ABSOLUTE, true>}, 
                         {IMMEDIATE, ZERO_PAGE, ABSOLUTE}, 
+                        {2, 3, 4},
                         "CPX");
 
     /// CPY (Compare Y Register
     create_instructions({0xC0, 0xC4, 0xCC}, 
                         {CMP_REG<IMMEDIATE, false>, CMP_REG<ZERO_PAGE, false>, CMP_REG<ABSOLUTE, false>}, 
                         {IMMEDIATE, ZERO_PAGE, ABSOLUTE},
+                        {2, 3, 4},
                         "CPY");
 
     /// DEC (Decrement Memory)
     create_instructions( {0xC6, 0xD6, 0xCE, 0xDE},
                          {INCDEC_MEMORY<ZERO_PAGE, false>, INCDEC_MEMORY<ZERO_PAGE_X, false>, INCDEC_MEMORY<ABSOLUTE, false>, INCDEC_MEMORY<ABSOLUTE_X, false>},
                          {ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X},
+                         {5, 6, 6, 7},
                          "DEC");
 
     /// DEX (Decrement X Register)
-    create_instructions({0xCA}, {INCDEC_REG<true, false>}, {IMPLIED}, "DEX");
+    create_instructions({0xCA}, {INCDEC_REG<true, false>}, {IMPLIED}, {2}, "DEX");
 
     /// DEY (Decrement Y Register)
-    create_instructions({0x88}, {INCDEC_REG<false, false>}, {IMPLIED}, "DEY");
+    create_instructions({0x88}, {INCDEC_REG<false, false>}, {IMPLIED}, {2}, "DEY");
 
     /// EOR (Exclusive OR)
     create_instructions({0x49, 0x45, 0x55, 0x4D, 0x5D, 0x59, 0x41, 0x51},
                         {EOR<IMMEDIATE>, EOR<ZERO_PAGE>, EOR<ZERO_PAGE_X>, EOR<ABSOLUTE>, EOR<ABSOLUTE_X>, EOR<ABSOLUTE_Y>, EOR<INDIRECT_X>, EOR<INDIRECT_Y>},
                         {IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
+                        {2, 3, 4, 4, 4, 4, 6, 5},
                         "EOR");
 
     /// INC (Increment Memory)
     create_instructions({0xE6, 0xF6, 0xEE, 0xFE}, 
                         {INCDEC_MEMORY<ZERO_PAGE, true>, INCDEC_MEMORY<ZERO_PAGE_X, true>, INCDEC_MEMORY<ABSOLUTE, true>, INCDEC_MEMORY<ABSOLUTE_X, true>},
                         {ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X},
+                        {5, 6, 6, 7},
                         "INC");
 
     /// INX (Increment X Register)
-    create_instructions({0xE8}, {INCDEC_REG<true, true>}, {IMPLIED}, "INX");
+    create_instructions({0xE8}, {INCDEC_REG<true, true>}, {IMPLIED}, {2}, "INX");
 
     /// INY (Increment Y Register)
-    create_instructions({0xC8}, {INCDEC_REG<false, true>}, {IMPLIED}, "INY");
+    create_instructions({0xC8}, {INCDEC_REG<false, true>}, {IMPLIED}, {2}, "INY");
 
     /// JMP (Jump)
     create_instructions({0x4C, 0x6C}, 
                         {JMP<ABSOLUTE, NORMAL_MODE>, JMP<INDIRECT, ALTERNATIVE_MODE>},
                         {ABSOLUTE, INDIRECT},
+                        {3, 5},
                         "JMP");
 
     /// JSR (Jump to Subroutine)
-    create_instructions({0x20}, {JSR<ABSOLUTE>}, {ABSOLUTE}, "JSR");
+    create_instructions({0x20}, {JSR<ABSOLUTE>}, {ABSOLUTE}, {6}, "JSR");
 
     /// LDA (Load Accumulator)
     create_instructions({0xA9, 0xA5, 0xB5, 0xAD, 0xBD, 0xB9, 0xA1, 0xB1},
                         {LDA<IMMEDIATE>, LDA<ZERO_PAGE>, LDA<ZERO_PAGE_X>, LDA<ABSOLUTE>, LDA<ABSOLUTE_X>, LDA<ABSOLUTE_Y>, LDA<INDIRECT_X>, LDA<INDIRECT_Y>},
                         {IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
+                        {2, 3, 4, 4, 4, 4, 6, 5},
                         "LDA");
 
     /// LDX (Load X Register)
     create_instructions({0xA2, 0xA6, 0xB6, 0xAE, 0xBE},
                         {LOAD_REG<IMMEDIATE, true>, LOAD_REG<ZERO_PAGE, true>, LOAD_REG<ZERO_PAGE_Y, true, ALTERNATIVE_MODE>, LOAD_REG<ABSOLUTE, true>, LOAD_REG<ABSOLUTE_Y, true>},
                         {IMMEDIATE, ZERO_PAGE, ZERO_PAGE_Y, ABSOLUTE, ABSOLUTE_Y},
+                        {2, 3, 4, 4, 4},
                         "LDX");
 
     /// LDY (Load Y Register)
     create_instructions({0xA0, 0xA4, 0xB4, 0xAC, 0xBC},
                         {LOAD_REG<IMMEDIATE, false>, LOAD_REG<ZERO_PAGE, false>, LOAD_REG<ZERO_PAGE_X, false>, LOAD_REG<ABSOLUTE, false>, LOAD_REG<ABSOLUTE_X, false>},
                         {IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X},
+                        {2, 3, 4, 4, 4},
                         "LDY");
 
     /// LSR (Logical Shift Right)
@@ -718,34 +687,37 @@ InstructionTable::InstructionTable(){
                         {BITSHIFT<ACCUMULATOR, Bitshift::SHIFT_RIGHT>, BITSHIFT<ZERO_PAGE, Bitshift::SHIFT_RIGHT>, BITSHIFT<ZERO_PAGE_X, Bitshift::SHIFT_RIGHT>,
                                 BITSHIFT<ABSOLUTE, Bitshift::SHIFT_RIGHT>, BITSHIFT<ABSOLUTE_X, Bitshift::SHIFT_RIGHT>},
                         {ACCUMULATOR, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X},
+                        {2, 5, 6, 6, 7},
                         "LSR");
 
     /// NOP (No Operation)
-    create_instructions({0xEA}, {NOP}, {IMPLIED}, "NOP");
+    create_instructions({0xEA}, {NOP}, {IMPLIED}, {2}, "NOP");
 
     /// ORA (Logical Inclusive OR)
     create_instructions({0x09, 0x05, 0x15, 0x0D, 0x1D, 0x19, 0x01, 0x11},
                         {ORA<IMMEDIATE>, ORA<ZERO_PAGE>, ORA<ZERO_PAGE_X>, ORA<ABSOLUTE>, ORA<ABSOLUTE_X>, ORA<ABSOLUTE_Y>, ORA<INDIRECT_X>, ORA<INDIRECT_Y>},
                         {IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
+                        {2, 3, 4, 4, 4, 4, 6, 5},
                         "ORA");
 
     /// PHA (Push Accumulator)
-    create_instructions({0x48}, {PUSH_REG<true>}, {IMPLIED}, "PHA");
+    create_instructions({0x48}, {PUSH_REG<true>}, {IMPLIED}, {3}, "PHA");
 
     /// PHP (Push Processor Status)
-    create_instructions({0x08}, {PUSH_REG<false>}, {IMPLIED}, "PHP");
+    create_instructions({0x08}, {PUSH_REG<false>}, {IMPLIED}, {3}, "PHP");
 
     /// PLA (Pull Accumulator)
-    create_instructions({0x68}, {PULL_REG<true>}, {IMPLIED}, "PLA");
+    create_instructions({0x68}, {PULL_REG<true>}, {IMPLIED}, {4}, "PLA");
 
     /// PLP (Pull Processor Status)
-    create_instructions({0x28}, {PULL_REG<false>}, {IMPLIED}, "PLP");
+    create_instructions({0x28}, {PULL_REG<false>}, {IMPLIED}, {4}, "PLP");
 
     /// ROL (Rotate Left)
     create_instructions({0x2A, 0x26, 0x36, 0x2E, 0x3E},
                         {BITSHIFT<ACCUMULATOR, Bitshift::ROTATE_LEFT>, BITSHIFT<ZERO_PAGE, Bitshift::ROTATE_LEFT>, BITSHIFT<ZERO_PAGE_X, Bitshift::ROTATE_LEFT>,
                          BITSHIFT<ABSOLUTE, Bitshift::ROTATE_LEFT>, BITSHIFT<ABSOLUTE_X, Bitshift::ROTATE_LEFT>},
                         {ACCUMULATOR, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X},
+                        {2, 5, 6, 6, 7},
                         "ROL");
 
     /// ROR (Rotate Right)
@@ -753,28 +725,30 @@ InstructionTable::InstructionTable(){
                         {BITSHIFT<ACCUMULATOR, Bitshift::ROTATE_RIGHT>, BITSHIFT<ZERO_PAGE, Bitshift::ROTATE_RIGHT>, BITSHIFT<ZERO_PAGE_X, Bitshift::ROTATE_RIGHT>,
                          BITSHIFT<ABSOLUTE, Bitshift::ROTATE_RIGHT>, BITSHIFT<ABSOLUTE_X, Bitshift::ROTATE_RIGHT>},
                         {ACCUMULATOR, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X},
+                        {2, 5, 6, 6, 7},
                         "ROR");
 
     /// RTI (Return from Interrupt)
-    create_instructions({0x40}, {RTI}, {IMPLIED}, "RTI");
+    create_instructions({0x40}, {RTI}, {IMPLIED}, {6}, "RTI");
 
     /// RTS (Return from Subroutine)
-    create_instructions({0x60}, {RTS}, {IMPLIED}, "RTS");
+    create_instructions({0x60}, {RTS}, {IMPLIED}, {6}, "RTS");
 
     // SBC (Subtract with Carry)
     create_instructions({0xE9, 0xE5, 0xF5, 0xED, 0xFD, 0xF9, 0xE1, 0xF1},
                         {SBC<IMMEDIATE>, SBC<ZERO_PAGE>, SBC<ZERO_PAGE_X>, SBC<ABSOLUTE>, SBC<ABSOLUTE_X>, SBC<ABSOLUTE_Y>, SBC<INDIRECT_X>, SBC<INDIRECT_Y>},
                         {IMMEDIATE, ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
+                        {2, 3, 4, 4, 4, 4, 6, 5},
                         "SBC");
 
     /// SEC (Set Carry Flag)
-    create_instructions({0x38}, {FLAGSET<CARRY_FLAG, true>}, {IMPLIED}, "SEC");
+    create_instructions({0x38}, {FLAGSET<CARRY_FLAG, true>}, {IMPLIED}, {2}, "SEC");
 
     /// SED (Set Decimal Flag)
-    create_instructions({0xF8}, {FLAGSET<DECIMAL_FLAG, true>}, {IMPLIED}, "SED");
+    create_instructions({0xF8}, {FLAGSET<DECIMAL_FLAG, true>}, {IMPLIED}, {2}, "SED");
 
     /// SEI (Set Interrupt Disable)
-    create_instructions({0x78}, {FLAGSET<INTERRUPT_DISABLE_FLAG, true>}, {IMPLIED}, "SEI");
+    create_instructions({0x78}, {FLAGSET<INTERRUPT_DISABLE_FLAG, true>}, {IMPLIED}, {2}, "SEI");
 
     /// STA (Store Accumulator)
     create_instructions({0x85, 0x95, 0x8D, 0x9D, 0x99, 0x81, 0x91},
@@ -782,42 +756,150 @@ InstructionTable::InstructionTable(){
                         STORE_REG<ABSOLUTE_X, Register::A>, STORE_REG<ABSOLUTE_Y, Register::A>, STORE_REG<INDIRECT_X, Register::A>,
                         STORE_REG<INDIRECT_Y, Register::A>},
                         {ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE, ABSOLUTE_X, ABSOLUTE_Y, INDIRECT_X, INDIRECT_Y},
+                        {3, 4, 4, 5, 5, 6, 6},
                         "STA");
 
     /// STX (Store X Register)
     create_instructions({0x86, 0x96, 0x8E},
-                        {STORE_REG<ZERO_PAGE, Register::X>, STORE_REG<ZERO_PAGE_Y, Register::X>, STORE_REG<ABSOLUTE, Register::X>},
+                        {STORE_REG<ZERO_PAGE, Register::X>, STORE_REG<ZERO_PAGE_Y, Register::X, ALTERNATIVE_MODE>, STORE_REG<ABSOLUTE, Register::X>},
                         {ZERO_PAGE, ZERO_PAGE_Y, ABSOLUTE},
+                        {3, 4, 4},
                         "STX");
 
     /// STY (Store Y Register)
     create_instructions({0x84, 0x94, 0x8C},
                         {STORE_REG<ZERO_PAGE, Register::Y>, STORE_REG<ZERO_PAGE_X, Register::Y>, STORE_REG<ABSOLUTE, Register::Y>},
                         {ZERO_PAGE, ZERO_PAGE_X, ABSOLUTE},
+                        {3, 4, 4},
                         "STY");
 
     /// TAX (Transfer Accumulator to X)
-    create_instructions({0xAA}, {TRANSFER_REG<Register::A, Register::X>}, {IMPLIED}, "TAX");
+    create_instructions({0xAA}, {TRANSFER_REG<Register::A, Register::X>}, {IMPLIED}, {2}, "TAX");
 
     /// TAY (Transfer Accumulator to Y)
-    create_instructions({0xA8}, {TRANSFER_REG<Register::A, Register::Y>}, {IMPLIED}, "TAY");
+    create_instructions({0xA8}, {TRANSFER_REG<Register::A, Register::Y>}, {IMPLIED}, {2}, "TAY");
 
     /// TSX (Transfer Stack Pointer to X)
-    create_instructions({0xBA}, {TRANSFER_REG<Register::SP, Register::X>}, {IMPLIED}, "TSX");
+    create_instructions({0xBA}, {TRANSFER_REG<Register::SP, Register::X>}, {IMPLIED}, {2}, "TSX");
 
     /// TXA (Transfer X to Accumulator)
-    create_instructions({0x8A}, {TRANSFER_REG<Register::X, Register::A>}, {IMPLIED}, "TXA");
+    create_instructions({0x8A}, {TRANSFER_REG<Register::X, Register::A>}, {IMPLIED}, {2}, "TXA");
 
     /// TXS (Transfer X to Stack Pointer)
-    create_instructions({0x9A}, {TRANSFER_REG<Register::X, Register::SP>}, {IMPLIED}, "TXS");
+    create_instructions({0x9A}, {TRANSFER_REG<Register::X, Register::SP>}, {IMPLIED}, {2}, "TXS");
 
     /// TYA (Transfer Y to Accumulator)
-    create_instructions({0x98}, {TRANSFER_REG<Register::Y, Register::A>}, {IMPLIED}, "TYA");
+    create_instructions({0x98}, {TRANSFER_REG<Register::Y, Register::A>}, {IMPLIED}, {2}, "TYA");
+}
+
+static constexpr InstructionTableBuilder built_tables;
+constexpr InstructionTable instruction_table = built_tables.hot;
+constexpr InstructionInfoTable instruction_info = built_tables.cold;
+
+/// BEGIN SUPERINSTRUCTIONS
+
+namespace superinstructions{
+    /// Runs the handlers of opcodes `First` and `Second` back to back.
+    template<uint8_t First, uint8_t Second>
+    static cycles fused(Cpu& cpu, operands op){
+        constexpr Instruction first = instruction_table.get(First);
+        constexpr Instruction second = instruction_table.get(Second);
+        static_assert(first.length <= 2 && second.length <= 2, "both operands have to fit in `operands`");
+        constexpr instruction_function<Cpu&> run_first = instruction_table.handler(first);
+        constexpr instruction_function<Cpu&> run_second = instruction_table.handler(second);
+        cycles cyc = run_first(cpu, op & 0xFF);
+        cpu.cycle_count += cyc; // the second instruction starts where the first ended, for the devices it touches
+        return cyc + run_second(cpu, op >> 8);
+    }
 
-    auto time_end = std::chrono::steady_clock::now();
-    std::cout << "InstructionTable Initialization Completed in " << std::chrono::duration_cast<std::chrono::microseconds>(time_end - time_begin).count() << " microseconds.\n";
+    struct Pair{
+        uint8_t first;
+        uint8_t second;
+        instruction_function<Cpu&> handler;
+    };
+
+    /// Loop counters and compares followed by a branch, and immediate stores. Revise with OpcodePairProfile
+    /// counts from real workloads; the first member of a pair must not access memory or read PC. A read may hit an
+    /// I/O register that raises an interrupt, which has to be taken before the second member runs.
+    static constexpr Pair pairs[] = {
+        {0xCA, 0xD0, fused<0xCA, 0xD0>}, // DEX; BNE
+        {0x88, 0xD0, fused<0x88, 0xD0>}, // DEY; BNE
+        {0xE8, 0xD0, fused<0xE8, 0xD0>}, // INX; BNE
+        {0xC8, 0xD0, fused<0xC8, 0xD0>}, // INY; BNE
+        {0xC9, 0xD0, fused<0xC9, 0xD0>}, // CMP #; BNE
+        {0xC9, 0xF0, fused<0xC9, 0xF0>}, // CMP #; BEQ
+        {0xE0, 0xD0, fused<0xE0, 0xD0>}, // CPX #; BNE
+        {0xC0, 0xD0, fused<0xC0, 0xD0>}, // CPY #; BNE
+        {0xE8, 0xE0, fused<0xE8, 0xE0>}, // INX; CPX #
+        {0xC8, 0xC0, fused<0xC8, 0xC0>}, // INY; CPY #
+        {0xA9, 0x85, fused<0xA9, 0x85>}, // LDA #; STA zp
+    };
+}
+
+instruction_function<Cpu&> superinstruction(uint8_t first, uint8_t second){
+    for (const auto& pair : superinstructions::pairs){
+        if (pair.first == first && pair.second == second)
+            return pair.handler;
+    }
+    return nullptr;
 }
 
-InstructionTable::~InstructionTable() {
-    std::cout << "InstructionTable Deinitialized!\n";
+/// BEGIN THREADED INTERPRETER
+
+#ifndef MUSTTAIL
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define MUSTTAIL [[clang::musttail]]
+#elif __has_cpp_attribute(gnu::musttail)
+#define MUSTTAIL [[gnu::musttail]]
+#endif
+#endif
+#endif
+
+namespace threaded{
+    using step_function = cycle_timestamp(*)(Cpu& cpu, cycle_timestamp now);
+
+    template<uint8_t Opcode>
+    static cycle_timestamp step(Cpu& cpu, cycle_timestamp now);
+
+    template<std::size_t... Opcodes>
+    constexpr std::array<step_function, 0x100> make_table(std::index_sequence<Opcodes...>){
+        return {step<(uint8_t)Opcodes>...};
+    }
+
+    static constexpr std::array<step_function, 0x100> table = make_table(std::make_index_sequence<0x100>{});
+
+    /// Runs the instruction at `cpu.PC`, which is known to be `Opcode`.
+    template<uint8_t Opcode>
+    static cycle_timestamp step(Cpu& cpu, cycle_timestamp now){
+        constexpr Instruction instr = instruction_table.get(Opcode);
+        constexpr instruction_function<Cpu&> handler = instruction_table.handler(instr);
+        operands op = 0;
+        if constexpr (instr.length == 3)
+            op = cpu.memory.get((uint16_t)(cpu.PC + 1)) | (cpu.memory.get((uint16_t)(cpu.PC + 2)) << 8);
+        else if constexpr (instr.length == 2)
+            op = cpu.memory.get((uint16_t)(cpu.PC + 1));
+        cpu.PC += instr.length;
+        cpu.cycle_count = now;
+        now += handler(cpu, op);
+        #ifdef MUSTTAIL
+        if (now >= cpu.slice_end)
+            return now;
+        MUSTTAIL return table[cpu.memory.get(cpu.PC)](cpu, now);
+        #else
+        return now;
+        #endif
+    }
+}
+
+cycle_timestamp run_threaded(Cpu& cpu, cycle_timestamp now){
+    #ifdef MUSTTAIL
+    if (now >= cpu.slice_end)
+        return now;
+    return threaded::table[cpu.memory.get(cpu.PC)](cpu, now);
+    #else
+    while (now < cpu.slice_end)
+        now = threaded::table[cpu.memory.get(cpu.PC)](cpu, now);
+    return now;
+    #endif
 }
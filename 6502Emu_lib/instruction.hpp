@@ -11,83 +11,84 @@
 #ifndef INSTRUCTION
 #define INSTRUCTION
 
-#define ENABLE_INSTRUCTION_DEBUG_INFO 1
+#ifndef ENABLE_INSTRUCTION_TRACE
+#define ENABLE_INSTRUCTION_TRACE 0 // prints every executed instruction; allocates, so keep it off outside of debugging.
+#endif
 
+#ifndef ENABLE_THREADED_INTERPRETER
+#define ENABLE_THREADED_INTERPRETER 0 // run loop dispatches through `run_threaded` instead of `Cpu::step`
+#endif
 
-struct Instruction{
-    instruction_function<Cpu&> func; /// function that takes in references to Cpu and Mem. Returns number of cycles taken to run.
-    #if ENABLE_INSTRUCTION_DEBUG_INFO
-    std::string id;
-    uint8_t opcode;     
-    AddressingMode mode;
-
-    Instruction() = default;
-    Instruction(instruction_function<Cpu&> func, std::string id, uint8_t opcode, AddressingMode mode):
-        func(std::move(func)),id(std::move(id)),opcode(opcode),mode(mode){}
-    #else
 
-    Instruction(instruction_function<Cpu&> func)
-    #endif
+/// Hot per-opcode entry: only what the dispatcher needs. Three bytes, so the entries for all 256 opcodes
+/// take up twelve cache lines.
+struct Instruction{
+    uint8_t handler = 0; /// index into InstructionTable::handlers
+    uint8_t base_cycles = 0; /// cycles taken without page-crossing or branch penalties
+    uint8_t length = 1; /// opcode byte + operand bytes
+};
 
-
-    auto run(Cpu& cpu) const -> cycles{
-        return func(cpu);
-    }
+/// Cold per-opcode metadata, kept out of the dispatch path. Used for disassembly and debugging.
+struct InstructionInfo{
+    const char* id = "???";
+    uint8_t opcode = 0xFF;
+    AddressingMode mode = IMPLIED;
+    uint8_t length = 1; /// opcode byte + operand bytes
 
     std::string to_string() const;
-    AddressingMode addr_mode() const;
 };
 
+/// Opcode -> handler lookup. The only instance is `instruction_table`, which is built entirely at compile time
+/// from the handler templates in instruction.cpp, so it needs no heap allocation or static initialization.
 struct InstructionTable{
-private:
-    // template<int N>
-    // auto create_instructions(const int (&codes)[N], const instruction_function<Cpu&> (&funcs)[N], std::string name){
-    //     for (int i = 0; i < N; i++){
-    //         #if ENABLE_INSTRUCTION_DEBUG_INFO
-    //         table[codes[i]] = Instruction(funcs[i], name, codes[i]);
-    //         #else
-    //         table[codes[i]] = Instruction(funcs[i]);
-    //         #endif
-    //     }
-    // }
-
-    template<int N>
-    auto create_instructions(const int (&codes)[N], const instruction_function<Cpu&> (&funcs)[N], const AddressingMode (&addr_modes)[N], std::string name){
-        for (int i = 0; i < N; i++){
-            #if ENABLE_INSTRUCTION_DEBUG_INFO
-            table[codes[i]] = Instruction(funcs[i], name, codes[i], addr_modes[i]);
-            #else
-            table[codes[i]] = Instruction(funcs[i]);
-            #endif
-        }
-    }
+    std::array<Instruction, 0x100> table;
+    std::array<instruction_function<Cpu&>, 0x100> handlers; /// every distinct handler, packed from index 0
 
-    auto create_instructions(const int code, const instruction_function<Cpu&> func, const AddressingMode mode, const std::string name){
-        #if ENABLE_INSTRUCTION_DEBUG_INFO
-        table[code] = Instruction(func, name, code, mode);
-        #else
-        table[code] = Instruction(func);
-        #endif
+    constexpr auto get(uint8_t opcode) const -> const Instruction&{
+        return table[opcode];
     }
-    std::array<Instruction, 0xFF> table;
-public:
-    InstructionTable();
-    ~InstructionTable();
 
-    auto get(std::size_t index) const -> const Instruction&{
-        return table.at(index);
+    constexpr auto handler(const Instruction& instr) const -> instruction_function<Cpu&>{
+        return handlers[instr.handler];
     }
+};
 
+/// Opcode -> metadata lookup, built at compile time alongside `instruction_table`.
+struct InstructionInfoTable{
+    std::array<InstructionInfo, 0x100> table;
+
+    constexpr auto get(uint8_t opcode) const -> const InstructionInfo&{
+        return table[opcode];
+    }
 };
 
+/// The opcode tables, constant-initialized in instruction.cpp.
+extern const InstructionTable instruction_table;
+extern const InstructionInfoTable instruction_info;
+
+/// Superinstruction running `first` and then `second` in one dispatch, or null if the pair has none.
+/// Both operands are packed into one: the first instruction's in the low byte, the second's in the high byte.
+/// The caller advances PC past both instructions first; no member of a pair reads PC or writes memory before
+/// the second instruction runs.
+instruction_function<Cpu&> superinstruction(uint8_t first, uint8_t second);
+
+/** Threaded interpreter core: runs from `cpu.PC` until `now` reaches `cpu.slice_end` and returns the new timestamp.
+ *
+ * Every opcode has its own step function with the operand fetch and handler call resolved at compile time. With
+ * guaranteed tail calls (`MUSTTAIL`), each step dispatches straight to the next opcode's step, so the indirect
+ * branches are spread over 256 sites and the cycle counter stays in argument registers. Without them, a plain loop
+ * calls the step functions instead.
+ */
+cycle_timestamp run_threaded(Cpu& cpu, cycle_timestamp now);
+
 struct DecompiledInstruction {
-    Instruction instruction;
+    InstructionInfo instruction;
     std::array<uint8_t, 3> raw;
     std::size_t addr;
 
-    DecompiledInstruction(Instruction instruction, std::array<uint8_t, 3> raw) : 
-        instruction(std::move(instruction)),raw(std::move(raw)),addr(0){}
-    DecompiledInstruction(InstructionTable const& table, Mem const& memory, std::size_t addr);
+    DecompiledInstruction(InstructionInfo instruction, std::array<uint8_t, 3> raw) :
+        instruction(instruction),raw(std::move(raw)),addr(0){}
+    DecompiledInstruction(InstructionInfoTable const& table, Mem const& memory, std::size_t addr);
 
     std::string to_string() const;
 };
@@ -101,6 +102,22 @@ namespace addressing{
             return static_cast<AddressingMode>(op & 0b00011100);
         }
 
+        /// Number of bytes (opcode included) taken up by an instruction using `mode`.
+        constexpr auto instruction_length(AddressingMode mode) -> uint8_t{
+            switch (mode){
+                case ACCUMULATOR:
+                case IMPLIED:
+                    return 1;
+                case ABSOLUTE:
+                case ABSOLUTE_X:
+                case ABSOLUTE_Y:
+                case INDIRECT:
+                    return 3;
+                default:
+                    return 2;
+            }
+        }
+
         template<AddressingMode Mode>
         constexpr bool contains_modes(AddressingMode mode){
             return Mode == mode;
@@ -133,6 +150,7 @@ namespace addressing{
 
         template<PSFlagType Flag, bool Value>
         constexpr void set_flag(Cpu& cpu){
+            static_assert(Flag != B_FLAGS, "set_flag is not compatible with PSFlagType B_FLAGS");
             switch (Flag){
                 case NEGATIVE_FLAG:
                     cpu.PS.N = Value;
@@ -140,8 +158,7 @@ namespace addressing{
                 case OVERFLOW_FLAG:
                     cpu.PS.V = Value;
                     break;
-                case B_FLAGS:
-                    throw std::runtime_error("set_flag is not compatible with PSFlagType B_FLAGS");
+                case B_FLAGS: // rejected above
                     break;
                 case DECIMAL_FLAG:
                     cpu.PS.D = Value;
@@ -157,13 +174,28 @@ namespace addressing{
             }
         }
 
+        /// Cycles for `Mode`, looked up in parallel lists of modes and cycles. Always evaluated at compile time:
+        /// a `Mode` missing from `modes` reaches the throw, which makes the call ill-formed instead of throwing.
         template<AddressingMode Mode, int N>
-        constexpr cycles get_cycles(const AddressingMode (&modes)[N], const cycles (&_cycles)[N]){
+        consteval cycles get_cycles(const AddressingMode (&modes)[N], const cycles (&_cycles)[N]){
             for (int i = 0; i < N; i++){
                 if (Mode == modes[i])
                     return _cycles[i];
             }
-            throw std::runtime_error("'mode' does not exist in 'modes'");
+            throw "'mode' does not exist in 'modes'";
+        }
+
+        /// The register `Reg` names.
+        template<Register::Enum Reg>
+        constexpr uint8_t& register_ref(Cpu& cpu){
+            if constexpr (Reg == Register::A)
+                return cpu.A;
+            else if constexpr (Reg == Register::X)
+                return cpu.X;
+            else if constexpr (Reg == Register::Y)
+                return cpu.Y;
+            else
+                return cpu.SP;
         }
 
         /** Returns the data from a certain addressing mode, and whether or not a page was crossed during addressing.
@@ -171,36 +203,40 @@ namespace addressing{
          * @tparam Mode The compile-time mode given to a function.
          * @tparam _type Two modes. NORMAL_MODE and ALTERNATIVE_MODE.
          * @tparam GetEffectiveAddress A boolean value used if an address is required instead of a value.
-         * @param cpu The CPU. The PC will be advanced to the address before the next instruction.
+         * @param cpu The CPU. The PC has already been advanced to the address of the next instruction.
+         * @param op The operand bytes of the instruction (little-endian), fetched by the dispatcher.
          * @return The value retrieved given the addressing mode, and whether or not a page file was crossed when retrieving the data.
          */
         template<AddressingMode Mode, ModeType _type, bool GetEffectiveAddress = false>
-        constexpr std::pair<uint16_t, bool> load_addr(Cpu& cpu){
+        constexpr std::pair<uint16_t, bool> load_addr(Cpu& cpu, operands op){
+            static_assert(_type == NORMAL_MODE
+                          ? contains_modes<INDIRECT_X, ZERO_PAGE, IMMEDIATE, ABSOLUTE, INDIRECT_Y, ZERO_PAGE_X, ABSOLUTE_Y, ABSOLUTE_X>(Mode)
+                          : contains_modes<ACCUMULATOR, INDIRECT, ZERO_PAGE_Y>(Mode),
+                          "Invalid Mode for this ModeType");
             uint16_t temp, temp2;
-            if (_type == NORMAL_MODE){
+            if constexpr (_type == NORMAL_MODE){
                 switch (Mode){
                     case INDIRECT_X:
-                        temp = (cpu.memory.get(cpu.PC++) + cpu.X) & 0x00FF; // Get zero-page address + X without carry (0x00FF).
+                        temp = (op + cpu.X) & 0x00FF; // Get zero-page address + X without carry (0x00FF).
                         temp = cpu.memory.get(temp) | (cpu.memory.get(temp + 1) << 8); // Get address at zero-page address.
                         if (GetEffectiveAddress) return std::pair(temp, false);
                         temp = cpu.memory.get(temp);
                         return std::pair(temp, false);
                     case ZERO_PAGE:
-                        temp = cpu.memory.get(cpu.PC++);
+                        temp = op & 0x00FF;
                         if (GetEffectiveAddress) return std::pair(temp, false);
                         temp = cpu.memory.get(temp);
                         return std::pair(temp, false);
                     case IMMEDIATE:
-                        if (GetEffectiveAddress) return std::pair(++cpu.PC, false);
-                        temp = cpu.memory.get(cpu.PC++);
+                        if (GetEffectiveAddress) return std::pair((uint16_t)(cpu.PC - 1), false);
+                        temp = op & 0x00FF;
                         return std::pair(temp, false);
                     case ABSOLUTE:
-                        cpu.PC += 2;
-                        if (GetEffectiveAddress) return std::pair(cpu.memory.get(cpu.PC - 2) | (cpu.memory.get(cpu.PC - 1) << 8), false);
-                        temp = cpu.memory.get(cpu.memory.get(cpu.PC - 2) | (cpu.memory.get(cpu.PC - 1) << 8)); // 16-bit address
+                        if (GetEffectiveAddress) return std::pair(op, false);
+                        temp = cpu.memory.get(op); // 16-bit address
                         return std::pair(temp, false);
                     case INDIRECT_Y:
-                        temp = cpu.memory.get(cpu.PC++); // Deref zero-page address
+                        temp = op & 0x00FF; // Deref zero-page address
                         temp2 = cpu.memory.get(temp);
                         temp2 = ((temp2 + cpu.Y) & 0x0100) >> 8; // Used to check if page has been crossed or has a carry bit.
                         temp = ((cpu.memory.get(temp) + cpu.Y) & 0x00FF) | ((cpu.memory.get(temp + 1) + temp2) << 8); // Address calculated from ($aa), Y
@@ -208,47 +244,42 @@ namespace addressing{
                             return std::pair(temp, temp2);
                         return std::pair(cpu.memory.get(temp) | (cpu.memory.get(temp + 1) << 8), temp2);
                     case ZERO_PAGE_X:
-                        temp = cpu.memory.get(cpu.PC++); // zero-page address
-                        temp = 0x00FF & (temp + cpu.X); // indexed zero-page address ( Adds X to $aaaa without carry )
+                        temp = 0x00FF & (op + cpu.X); // indexed zero-page address ( Adds X to $aaaa without carry )
                         if (GetEffectiveAddress) return std::pair(temp, false);
                         return std::pair(cpu.memory.get(temp), false); // Returns byte at indexed zero-page address.
                     case ABSOLUTE_Y:
-                        cpu.PC += 2;
-                        temp = cpu.memory.get(cpu.PC - 2) | (cpu.memory.get(cpu.PC - 1) << 8); // 16-bit address
+                        temp = op; // 16-bit address
                         temp2 =  ((temp + cpu.Y) & 0xFF00) ^ (temp & 0xFF00); // Checks if page is crossed when indexing.
                         if (GetEffectiveAddress) return std::pair(temp + cpu.Y, temp2);
                         return std::pair(cpu.memory.get(temp+cpu.Y), temp2);
                     case ABSOLUTE_X:
-                        cpu.PC += 2;
-                        temp = cpu.memory.get(cpu.PC - 2) | (cpu.memory.get(cpu.PC - 1) << 8); // 16-bit address
+                        temp = op; // 16-bit address
                         temp2 =  ((temp + cpu.X) & 0xFF00) ^ (temp & 0xFF00); // Checks if page is crossed when indexing.
                         if (GetEffectiveAddress) return std::pair(temp + cpu.X, temp2);
                         return std::pair(cpu.memory.get(temp+cpu.X), temp2);
-                    default:
-                        throw std::runtime_error("Invalid Mode in NormalMode");
+                    default: // rejected above
+                        __builtin_unreachable();
                 }
             } else {
                 switch (Mode){
                     case ACCUMULATOR: // instruction is 1-byte, therefore nothing should be returned.
                         return std::pair(0, false);
                     case INDIRECT: // Only used in JMP instruction.
-                        temp = cpu.memory.get(cpu.PC) | (cpu.memory.get(cpu.PC + 1) << 8);
-                        temp = cpu.memory.get(temp) | (cpu.memory.get(temp + 1) << 8); // 16-bit address
+                        temp = cpu.memory.get(op) | (cpu.memory.get(op + 1) << 8); // 16-bit address
                         return std::pair(temp, false); // Return addr -> addr.
                     case ZERO_PAGE_Y:
-                        temp = cpu.memory.get(cpu.PC++); // zero-page address
-                        temp = 0x00FF & (temp + cpu.Y); // indexed zero-page address ( Adds Y to $aaaa without carry )
+                        temp = 0x00FF & (op + cpu.Y); // indexed zero-page address ( Adds Y to $aaaa without carry )
                         if (GetEffectiveAddress) return std::pair(temp, false);
                         return std::pair(cpu.memory.get(temp), false); // Returns byte at indexed zero-page address.
-                    default:
-                        throw std::runtime_error("Invalid Mode in _type");
+                    default: // rejected above
+                        __builtin_unreachable();
                 }
             }
         }
 
         template<AddressingMode Mode, ModeType _type>
-        constexpr std::pair<uint16_t, bool> load_addr_ref(Cpu& cpu){
-            return load_addr<Mode, _type, true>(cpu);
+        constexpr std::pair<uint16_t, bool> load_addr_ref(Cpu& cpu, operands op){
+            return load_addr<Mode, _type, true>(cpu, op);
         }
 
     }
@@ -262,78 +293,78 @@ namespace instructions{
     }
 
         template<AddressingMode Mode>
-        static cycles ADC(Cpu& cpu);
+        static cycles ADC(Cpu& cpu, operands op);
 
         template<AddressingMode Mode>
-        static cycles AND(Cpu& cpu);
+        static cycles AND(Cpu& cpu, operands op);
 
         template<AddressingMode Mode>
-        static cycles ASL(Cpu& cpu);
+        static cycles ASL(Cpu& cpu, operands op);
 
         template<PSFlagType Flag, bool IsSet>
-        static cycles BRANCH(Cpu& cpu);
+        static cycles BRANCH(Cpu& cpu, operands op);
 
         template<AddressingMode Mode>
-        static cycles BIT(Cpu &cpu);
+        static cycles BIT(Cpu& cpu, operands op);
 
-        static cycles BRK(Cpu &cpu);
+        static cycles BRK(Cpu& cpu, operands op);
 
         template<PSFlagType Flag, bool Value>
-        static cycles FLAGSET(Cpu& cpu);
+        static cycles FLAGSET(Cpu& cpu, operands op);
 
         template<AddressingMode Mode>
-        static cycles CMP(Cpu& cpu);
+        static cycles CMP(Cpu& cpu, operands op);
 
         template<AddressingMode Mode, bool IsX>
-        static cycles CMP_REG(Cpu& cpu);
+        static cycles CMP_REG(Cpu& cpu, operands op);
 
         template<AddressingMode Mode, bool IsIncrement>
-        static cycles INCDEC_MEMORY(Cpu& cpu);
+        static cycles INCDEC_MEMORY(Cpu& cpu, operands op);
 
         template<bool IsX, bool IsIncrement>
-        static cycles INCDEC_REG(Cpu& cpu);
+        static cycles INCDEC_REG(Cpu& cpu, operands op);
 
         template<AddressingMode AMode, ModeType MMode>
-        static cycles JMP(Cpu& cpu);
+        static cycles JMP(Cpu& cpu, operands op);
 
         template<AddressingMode Mode>
-        static cycles JSR(Cpu& cpu);
+        static cycles JSR(Cpu& cpu, operands op);
 
         template<AddressingMode Mode>
-        static cycles LDA(Cpu& cpu);
+        static cycles LDA(Cpu& cpu, operands op);
 
         template<AddressingMode Mode, bool IsX, ModeType MMode = NORMAL_MODE>
-        static cycles LOAD_REG(Cpu& cpu);
+        static cycles LOAD_REG(Cpu& cpu, operands op);
 
         template<AddressingMode Mode, Bitshift::Enum ShiftType>
-        static cycles BITSHIFT(Cpu& cpu);
+        static cycles BITSHIFT(Cpu& cpu, operands op);
 
-        static cycles NOP(Cpu& cpu);
+        static cycles NOP(Cpu& cpu, operands op);
 
         template<AddressingMode Mode>
-        static cycles ORA(Cpu& cpu);
+        static cycles ORA(Cpu& cpu, operands op);
 
         template<bool IsAcc>
-        static cycles PUSH_REG(Cpu& cpu);
+        static cycles PUSH_REG(Cpu& cpu, operands op);
 
         template<bool IsAcc>
-        static cycles PULL_REG(Cpu& cpu);
+        static cycles PULL_REG(Cpu& cpu, operands op);
 
         template<AddressingMode Mode>
-        static cycles EOR(Cpu& cpu);
+        static cycles EOR(Cpu& cpu, operands op);
 
-        static cycles RTI(Cpu& cpu);
+        static cycles RTI(Cpu& cpu, operands op);
 
-        static cycles RTS(Cpu& cpu);
+        static cycles RTS(Cpu& cpu, operands op);
 
         template<AddressingMode Mode>
-        static cycles SBC(Cpu& cpu);
+        static cycles SBC(Cpu& cpu, operands op);
 
-        template<AddressingMode Mode, Register::Enum Reg>
-        static cycles STORE_REG(Cpu& cpu);
+        template<AddressingMode Mode, Register::Enum Reg, ModeType MMode = NORMAL_MODE>
+        static cycles STORE_REG(Cpu& cpu, operands op);
 
         template<Register::Enum FromReg, Register::Enum ToReg>
-        static cycles TRANSFER_REG(Cpu& cpu);
+        static cycles TRANSFER_REG(Cpu& cpu, operands op);
 }
 
 
@@ -0,0 +1,359 @@
+#include "jit.hpp"
+#include "cpu.hpp"
+#include <cstring>
+#include <stdexcept>
+
+#if ENABLE_JIT
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/// Processor status bits, as laid out by `PS.conv()`.
+namespace status{
+    constexpr uint8_t C = 0x01, Z = 0x02, I = 0x04, D = 0x08, V = 0x40, N = 0x80;
+}
+
+/*
+ * Register use in generated code:
+ *   rbx = Cpu*, r12 = current cycle timestamp, r14 = invalidation flag. The end of the slice is read from
+ *   [rbx + slice_end] at every check, since a handler may lower it. r12 is stored to [rbx + cycle_count] before
+ *   every handler call, for devices the handler touches.
+ *   al, cl, dl, r8b are scratch and may be clobbered by handler calls.
+ * All accesses to Cpu registers are [rbx + disp32].
+ */
+namespace {
+    constexpr uint8_t EAX = 0, ECX = 1;
+
+    /// Byte offset of `member` inside `cpu`.
+    template<typename T>
+    int32_t offset_in(const Cpu& cpu, const T& member){
+        return (int32_t)(reinterpret_cast<const char*>(&member) - reinterpret_cast<const char*>(&cpu));
+    }
+}
+
+bool Jit::available(){
+    return ENABLE_JIT;
+}
+
+Jit::Jit(const Cpu& cpu){
+    off_A = offset_in(cpu, cpu.A);
+    off_X = offset_in(cpu, cpu.X);
+    off_Y = offset_in(cpu, cpu.Y);
+    off_SP = offset_in(cpu, cpu.SP);
+    off_PC = offset_in(cpu, cpu.PC);
+    off_PS = offset_in(cpu, cpu.PS);
+    off_slice_end = offset_in(cpu, cpu.slice_end);
+    off_cycle_count = offset_in(cpu, cpu.cycle_count);
+    #if ENABLE_LAZY_FLAGS
+    off_N = offset_in(cpu, cpu.PS.N);
+    off_Z = offset_in(cpu, cpu.PS.Z);
+    constexpr uint8_t packed = (uint8_t)~(status::N | status::Z); // N and Z are stored on their own
+    #else
+    constexpr uint8_t packed = 0xFF;
+    #endif
+
+    // Generated code updates the other flags as one byte, so its storage has to match conv().
+    auto ps = cpu.PS;
+    ps.set(0xC5);
+    uint8_t raw;
+    std::memcpy(&raw, &ps, 1);
+    if ((raw & packed) != (ps.conv() & packed))
+        throw std::runtime_error("Jit: unsupported processor status layout");
+
+    #if ENABLE_JIT
+    void* mem = mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        throw std::runtime_error("Jit: could not map code buffer");
+    buffer = static_cast<uint8_t*>(mem);
+    host_page_size = (std::size_t)sysconf(_SC_PAGESIZE);
+    if (mprotect(buffer, BUFFER_SIZE, PROT_READ | PROT_EXEC) != 0){
+        munmap(buffer, BUFFER_SIZE);
+        buffer = nullptr;
+        throw std::runtime_error("Jit: code buffer cannot be made executable");
+    }
+    #else
+    throw std::runtime_error("Jit: not supported on this host");
+    #endif
+}
+
+Jit::~Jit(){
+    #if ENABLE_JIT
+    if (buffer)
+        munmap(buffer, BUFFER_SIZE);
+    #endif
+}
+
+void Jit::reset(){
+    used = 0;
+    out_of_space = false;
+}
+
+bool Jit::protect(uint8_t* at, std::size_t size, int protection){
+    #if ENABLE_JIT
+    // `buffer` is page-aligned, so offsets into it round to host pages.
+    std::size_t first = (std::size_t)(at - buffer) & ~(host_page_size - 1);
+    std::size_t last = ((std::size_t)(at - buffer) + size + host_page_size - 1) & ~(host_page_size - 1);
+    return mprotect(buffer + first, last - first, protection) == 0;
+    #else
+    return false;
+    #endif
+}
+
+native_block Jit::compile(const Block& block){
+    #if ENABLE_JIT
+    code.clear();
+    std::vector<std::size_t> exits;
+
+    // Prologue: save callee-saved registers (five pushes keep the stack 16-byte aligned for handler calls).
+    emit({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57}); // push rbx, r12, r13, r14, r15
+    emit({0x48, 0x89, 0xFB}); // mov rbx, rdi
+    emit({0x49, 0x89, 0xF4}); // mov r12, rsi
+    emit({0x49, 0x89, 0xD6}); // mov r14, rdx
+
+    uint32_t pc = block.start;
+    bool pc_stored = true;
+    std::size_t inlined = 0;
+    for (const DecodedInstruction& instr : block.instructions){
+        pc += instr.length;
+        pc_stored = emit_instruction(instr, (uint16_t)pc, exits);
+        inlined += !pc_stored;
+    }
+    // Mostly handler calls: the interpreter runs those at least as fast.
+    if (inlined * MIN_INLINE_SHARE < block.instructions.size())
+        return nullptr;
+    if (!pc_stored)
+        emit_store_pc((uint16_t)pc); // the block ran to its end on an inline instruction
+
+    std::size_t exit = code.size();
+    for (std::size_t at : exits)
+        patch_jump(at, exit);
+    emit({0x4C, 0x89, 0xE0}); // mov rax, r12
+    emit({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B}); // pop r15, r14, r13, r12, rbx
+    emit({0xC3}); // ret
+
+    if (used + code.size() > BUFFER_SIZE){
+        out_of_space = true;
+        return nullptr;
+    }
+    uint8_t* entry = buffer + used;
+    if (!protect(entry, code.size(), PROT_READ | PROT_WRITE)){
+        protection_failed = true;
+        return nullptr;
+    }
+    std::memcpy(entry, code.data(), code.size());
+    if (!protect(entry, code.size(), PROT_READ | PROT_EXEC)){
+        protection_failed = true; // blocks sharing these pages cannot run any more either
+        return nullptr;
+    }
+    used += (code.size() + 15) & ~(std::size_t)15;
+    compiled++;
+    return reinterpret_cast<native_block>(entry);
+    #else
+    return nullptr;
+    #endif
+}
+
+/// Returns whether PC has been written back (always the case after a handler call, which may also change it).
+bool Jit::emit_instruction(const DecodedInstruction& instr, uint16_t next_pc, std::vector<std::size_t>& exits){
+    if (emit_inline(instr)){
+        // Inline code never looks at PC, so it is only written back when leaving the block.
+        emit_compare_slice_end();
+        emit({0x72, 14}); // jb over the exit below
+        emit_store_pc(next_pc);
+        exits.push_back(emit_jump({0xE9})); // jmp exit
+        return false;
+    }
+    // PC points at the next instruction, as the dispatcher leaves it before running a handler.
+    emit_store_pc(next_pc);
+    emit_handler_call(instr);
+    emit({0x41, 0x80, 0x3E, 0x00}); // cmp byte [r14], 0
+    exits.push_back(emit_jump({0x0F, 0x85})); // jne exit
+    emit_compare_slice_end();
+    exits.push_back(emit_jump({0x0F, 0x83})); // jae exit
+    return true;
+}
+
+/// cmp r12, [rbx+slice_end]
+void Jit::emit_compare_slice_end(){
+    emit({0x4C, 0x3B, 0xA3});
+    emit32(off_slice_end);
+}
+
+/// mov word [rbx+PC], imm16 (9 bytes)
+void Jit::emit_store_pc(uint16_t pc){
+    emit({0x66, 0xC7, (uint8_t)(0x80 | 3)});
+    emit32(off_PC);
+    emit({(uint8_t)pc, (uint8_t)(pc >> 8)});
+}
+
+void Jit::emit_handler_call(const DecodedInstruction& instr){
+    emit({0x4C, 0x89, 0xA3}); // mov [rbx+cycle_count], r12
+    emit32(off_cycle_count);
+    emit({0x48, 0x89, 0xDF}); // mov rdi, rbx
+    emit({0xBE}); // mov esi, imm32
+    emit32(instr.op);
+    emit({0x48, 0xB8}); // mov rax, imm64
+    emit64(reinterpret_cast<uint64_t>(instr.handler));
+    emit({0xFF, 0xD0}); // call rax
+    emit({0x89, 0xC0}); // mov eax, eax (upper half of a 32-bit return value is undefined)
+    emit({0x49, 0x01, 0xC4}); // add r12, rax
+}
+
+/// Emits `op reg8, [rbx+disp32]`-style instructions: opcode bytes followed by a [rbx+disp32] ModRM.
+#define EMIT_RBX(reg, off, ...) do { emit({__VA_ARGS__}); emit({(uint8_t)(0x80 | ((reg) << 3) | 3)}); emit32(off); } while (0)
+
+bool Jit::emit_inline(const DecodedInstruction& instr){
+    auto load_al = [&](int32_t off){ EMIT_RBX(EAX, off, 0x8A); }; // mov al, [rbx+off]
+    auto store_al = [&](int32_t off){ EMIT_RBX(EAX, off, 0x88); }; // mov [rbx+off], al
+    auto ps_and = [&](uint8_t mask){ EMIT_RBX(4, off_PS, 0x80); emit({mask}); }; // and byte [rbx+PS], imm8
+    auto ps_or = [&](uint8_t bits){ EMIT_RBX(1, off_PS, 0x80); emit({bits}); }; // or byte [rbx+PS], imm8
+    auto transfer = [&](int32_t from, int32_t to, bool flags){
+        load_al(from);
+        store_al(to);
+        if (flags) emit_set_nz();
+    };
+    auto incdec = [&](int32_t reg, bool inc){
+        load_al(reg);
+        emit({0xFE, (uint8_t)(inc ? 0xC0 : 0xC8)}); // inc al / dec al
+        store_al(reg);
+        emit_set_nz();
+    };
+    auto logic_imm = [&](uint8_t opcode){
+        load_al(off_A);
+        emit({opcode, (uint8_t)instr.op}); // and/or/xor al, imm8
+        store_al(off_A);
+        emit_set_nz();
+    };
+    auto load_imm = [&](int32_t reg){
+        uint8_t value = instr.op;
+        EMIT_RBX(0, reg, 0xC6); emit({value}); // mov byte [rbx+reg], imm8
+        #if ENABLE_LAZY_FLAGS
+        EMIT_RBX(0, off_N, 0xC6); emit({value}); // mov byte [rbx+N], imm8
+        EMIT_RBX(0, off_Z, 0xC6); emit({value}); // mov byte [rbx+Z], imm8
+        #else
+        ps_and((uint8_t)~(status::N | status::Z));
+        uint8_t bits = (value & status::N) | (value ? 0 : status::Z);
+        if (bits) ps_or(bits);
+        #endif
+    };
+    auto compare_imm = [&](int32_t reg){
+        load_al(reg);
+        EMIT_RBX(ECX, off_PS, 0x0F, 0xB6); // movzx ecx, byte [rbx+PS]
+        emit({0x3C, (uint8_t)instr.op}); // cmp al, imm8
+        emit({0x0F, 0x93, 0xC2}); // setae dl
+        emit({0x80, 0xE1, (uint8_t)~status::C}); // and cl, imm8
+        emit({0x08, 0xD1}); // or cl, dl
+        EMIT_RBX(ECX, off_PS, 0x88); // mov [rbx+PS], cl
+        emit({0x2C, (uint8_t)instr.op}); // sub al, imm8
+        emit_set_nz();
+    };
+
+    switch (instr.opcode){
+        case 0xA9: load_imm(off_A); break; // LDA #
+        case 0xA2: load_imm(off_X); break; // LDX #
+        case 0xA0: load_imm(off_Y); break; // LDY #
+        case 0x29: logic_imm(0x24); break; // AND #
+        case 0x09: logic_imm(0x0C); break; // ORA #
+        case 0x49: logic_imm(0x34); break; // EOR #
+        case 0xC9: compare_imm(off_A); break; // CMP #
+        case 0xE0: compare_imm(off_X); break; // CPX #
+        case 0xC0: compare_imm(off_Y); break; // CPY #
+        case 0xAA: transfer(off_A, off_X, true); break; // TAX
+        case 0xA8: transfer(off_A, off_Y, true); break; // TAY
+        case 0x8A: transfer(off_X, off_A, true); break; // TXA
+        case 0x98: transfer(off_Y, off_A, true); break; // TYA
+        case 0xBA: transfer(off_SP, off_X, true); break; // TSX
+        case 0x9A: transfer(off_X, off_SP, false); break; // TXS
+        case 0xE8: incdec(off_X, true); break; // INX
+        case 0xC8: incdec(off_Y, true); break; // INY
+        case 0xCA: incdec(off_X, false); break; // DEX
+        case 0x88: incdec(off_Y, false); break; // DEY
+        case 0x18: ps_and((uint8_t)~status::C); break; // CLC
+        case 0x38: ps_or(status::C); break; // SEC
+        case 0x78: ps_or(status::I); break; // SEI
+        case 0xD8: ps_and((uint8_t)~status::D); break; // CLD
+        case 0xF8: ps_or(status::D); break; // SED
+        case 0xB8: ps_and((uint8_t)~status::V); break; // CLV
+        case 0xEA: break; // NOP
+        case 0x69: // ADC #
+        case 0xE9: { // SBC # (binary SBC is ADC of the inverted operand)
+            EMIT_RBX(0, off_PS, 0xF6); emit({status::D}); // test byte [rbx+PS], D
+            std::size_t decimal = emit_jump({0x0F, 0x85}); // jnz decimal
+            emit_adc_imm(instr.opcode == 0x69 ? (uint8_t)instr.op : (uint8_t)~instr.op);
+            emit({0x49, 0x83, 0xC4, instr.base_cycles}); // add r12, imm8
+            std::size_t done = emit_jump({0xE9}); // jmp done
+            patch_jump(decimal, code.size());
+            emit_handler_call(instr); // decimal mode stays with the handler, which does not need PC
+            patch_jump(done, code.size());
+            return true;
+        }
+        default:
+            return false;
+    }
+    emit({0x49, 0x83, 0xC4, instr.base_cycles}); // add r12, imm8
+    return true;
+}
+
+void Jit::emit_adc_imm(uint8_t value){
+    EMIT_RBX(EAX, off_A, 0x8A); // mov al, [rbx+A]
+    EMIT_RBX(ECX, off_PS, 0x0F, 0xB6); // movzx ecx, byte [rbx+PS]
+    emit({0x0F, 0xBA, 0xE1, 0x00}); // bt ecx, 0 (CF = carry)
+    emit({0x14, value}); // adc al, imm8
+    emit({0x0F, 0x92, 0xC2}); // setc dl
+    emit({0x41, 0x0F, 0x90, 0xC0}); // seto r8b
+    EMIT_RBX(EAX, off_A, 0x88); // mov [rbx+A], al
+    emit({0x80, 0xE1, (uint8_t)~(status::V | status::C)}); // and cl, imm8
+    emit({0x08, 0xD1}); // or cl, dl
+    emit({0x41, 0xC0, 0xE0, 0x06}); // shl r8b, 6
+    emit({0x44, 0x08, 0xC1}); // or cl, r8b
+    EMIT_RBX(ECX, off_PS, 0x88); // mov [rbx+PS], cl
+    emit_set_nz();
+}
+
+/// Sets N and Z from al. May clobber cl and dl.
+void Jit::emit_set_nz(){
+    #if ENABLE_LAZY_FLAGS
+    EMIT_RBX(EAX, off_N, 0x88); // mov [rbx+N], al
+    EMIT_RBX(EAX, off_Z, 0x88); // mov [rbx+Z], al
+    #else
+    EMIT_RBX(ECX, off_PS, 0x0F, 0xB6); // movzx ecx, byte [rbx+PS]
+    emit({0x80, 0xE1, (uint8_t)~(status::N | status::Z)}); // and cl, imm8
+    emit({0x88, 0xC2}); // mov dl, al
+    emit({0x80, 0xE2, status::N}); // and dl, 0x80
+    emit({0x08, 0xD1}); // or cl, dl
+    emit({0x84, 0xC0}); // test al, al
+    emit({0x75, 0x03}); // jnz +3
+    emit({0x80, 0xC9, status::Z}); // or cl, Z
+    EMIT_RBX(ECX, off_PS, 0x88); // mov [rbx+PS], cl
+    #endif
+}
+
+#undef EMIT_RBX
+
+void Jit::emit(std::initializer_list<uint8_t> bytes){
+    for (uint8_t byte : bytes)
+        code.push_back(byte);
+}
+
+void Jit::emit32(uint32_t value){
+    for (int i = 0; i < 4; i++)
+        code.push_back((uint8_t)(value >> (8 * i)));
+}
+
+void Jit::emit64(uint64_t value){
+    for (int i = 0; i < 8; i++)
+        code.push_back((uint8_t)(value >> (8 * i)));
+}
+
+/// Emits a jump with a 32-bit displacement and returns where the displacement goes, for `patch_jump`.
+std::size_t Jit::emit_jump(std::initializer_list<uint8_t> opcode){
+    emit(opcode);
+    std::size_t at = code.size();
+    emit32(0);
+    return at;
+}
+
+void Jit::patch_jump(std::size_t at, std::size_t target){
+    uint32_t rel = (uint32_t)(target - (at + 4));
+    std::memcpy(&code[at], &rel, 4);
+}
@@ -0,0 +1,89 @@
+#ifndef JIT
+#define JIT
+#include "block_cache.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifndef ENABLE_JIT
+#if defined(__x86_64__) && defined(__linux__)
+#define ENABLE_JIT 1
+#else
+#define ENABLE_JIT 0
+#endif
+#endif
+
+/** x86-64 translator for hot blocks.
+ *
+ * Register-only instructions (immediate loads and logic, ADC/SBC/CMP #imm in binary mode, transfers, INX/DEX,
+ * flag instructions other than CLI, which may unmask an interrupt) are emitted inline. Everything else becomes a
+ * direct call to the instruction's handler, so memory access, page-crossing penalties, decimal mode and control
+ * flow keep the interpreter's semantics exactly.
+ * After every handler call the code checks the cache's invalidation flag, so a store into a code page leaves the
+ * block just like it does in the interpreter.
+ *
+ * Handler calls cost a little more than the interpreter's dispatch, so a block is only translated if at least one
+ * in `MIN_INLINE_SHARE` of its instructions is emitted inline. Other blocks stay interpreted.
+ *
+ * Code lives in one mmap'd buffer. Only the pages a block is being emitted into are writable, and only while it is
+ * (W^X). If the host refuses to make them executable again, `compile` fails and the Jit has to be dropped.
+ */
+class Jit{
+public:
+    static const uint32_t HOT_THRESHOLD = 32; /// block entries before a block gets translated
+    static const std::size_t BUFFER_SIZE = 4 << 20;
+    static const std::size_t MIN_INLINE_SHARE = 4; /// one in this many instructions of a block must be inlined
+
+    /// Register offsets are taken from `cpu`; every Cpu has the same layout. Throws if the host does not allow
+    /// executable memory.
+    explicit Jit(const Cpu& cpu);
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    /// Whether native code can be generated on this host.
+    static bool available();
+
+    /// Translates `block`. Returns null if too few of its instructions can be inlined, if the code buffer is
+    /// full (`full()`; call `reset` and try again) or if the host refused to change the protection of the buffer
+    /// (`broken()`).
+    native_block compile(const Block& block);
+    /// Throws away all generated code. Every `native_block` handed out before becomes invalid.
+    void reset();
+
+    std::size_t compiled_count() const { return compiled; }
+    /// Whether the last `compile` failed for lack of space.
+    bool full() const { return out_of_space; }
+    /// Whether changing the protection of the buffer has failed. Code emitted before may no longer be executable,
+    /// so none of it may run again.
+    bool broken() const { return protection_failed; }
+
+private:
+    uint8_t* buffer = nullptr;
+    std::size_t host_page_size = 0;
+    std::size_t used = 0;
+    std::size_t compiled = 0;
+    bool out_of_space = false;
+    bool protection_failed = false;
+    int32_t off_A, off_X, off_Y, off_SP, off_PC, off_PS, off_slice_end, off_cycle_count;
+    int32_t off_N = 0, off_Z = 0; /// lazily evaluated flags (ENABLE_LAZY_FLAGS)
+    std::vector<uint8_t> code;
+
+    /// Sets the protection of the host pages holding `size` bytes at `at`.
+    bool protect(uint8_t* at, std::size_t size, int protection);
+    bool emit_instruction(const DecodedInstruction& instr, uint16_t next_pc, std::vector<std::size_t>& exits);
+    bool emit_inline(const DecodedInstruction& instr);
+    void emit_handler_call(const DecodedInstruction& instr);
+    void emit_store_pc(uint16_t pc);
+    void emit_compare_slice_end();
+    void emit_set_nz();
+    void emit_adc_imm(uint8_t value);
+
+    void emit(std::initializer_list<uint8_t> bytes);
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+    std::size_t emit_jump(std::initializer_list<uint8_t> opcode);
+    void patch_jump(std::size_t at, std::size_t target);
+};
+
+#endif
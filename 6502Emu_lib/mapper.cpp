@@ -0,0 +1,150 @@
+#include "mapper.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/format.h>
+
+Cartridge Cartridge::from_ines(const std::vector<uint8_t>& image){
+    const std::size_t HEADER_SIZE = 16;
+    const std::size_t TRAINER_SIZE = 512;
+    if (image.size() < HEADER_SIZE || image[0] != 'N' || image[1] != 'E' || image[2] != 'S' || image[3] != 0x1A)
+        throw std::runtime_error("not an iNES image");
+
+    Cartridge cartridge;
+    std::size_t prg_size = image[4] * PRG_BANK_SIZE;
+    std::size_t chr_size = image[5] * CHR_BANK_SIZE;
+    std::size_t offset = HEADER_SIZE + (image[6] & 0x04 ? TRAINER_SIZE : 0);
+    cartridge.mapper = (image[6] >> 4) | (image[7] & 0xF0);
+    if (prg_size == 0)
+        throw std::runtime_error("iNES image has no PRG ROM");
+    if (image.size() < offset + prg_size + chr_size)
+        throw std::runtime_error(fmt::format("iNES image is truncated: {} bytes, expected {}", image.size(),
+                                             offset + prg_size + chr_size));
+    cartridge.prg.assign(image.begin() + offset, image.begin() + offset + prg_size);
+    offset += prg_size;
+    cartridge.chr.assign(image.begin() + offset, image.begin() + offset + chr_size);
+    return cartridge;
+}
+
+std::unique_ptr<Mapper> Mapper::create(std::shared_ptr<const Cartridge> cartridge, Mem& memory){
+    switch (cartridge->mapper){
+        case 0: return std::make_unique<NROM>(std::move(cartridge), memory);
+        case 1: return std::make_unique<MMC1>(std::move(cartridge), memory);
+        case 2: return std::make_unique<UxROM>(std::move(cartridge), memory);
+        case 3: return std::make_unique<CNROM>(std::move(cartridge), memory);
+        default:
+            throw std::runtime_error(fmt::format("unsupported mapper {}", cartridge->mapper));
+    }
+}
+
+Mapper::Mapper(std::shared_ptr<const Cartridge> cartridge, Mem& memory) : cart(std::move(cartridge)), memory(memory){
+    if (cart->chr.empty())
+        chr_ram.resize(Cartridge::CHR_BANK_SIZE);
+}
+
+Mapper::~Mapper(){
+    memory.unmap(0x8000 / Mem::PAGE_SIZE, 0x8000 / Mem::PAGE_SIZE);
+}
+
+void Mapper::map_prg(uint16_t addr, std::size_t size, std::size_t bank){
+    std::size_t first_page = addr / Mem::PAGE_SIZE;
+    std::size_t pages = size / Mem::PAGE_SIZE;
+    // A window larger than the whole ROM shows the ROM repeatedly.
+    std::size_t mapped = std::min(pages, cart->prg.size() / Mem::PAGE_SIZE);
+    std::size_t banks = std::max<std::size_t>(prg_banks(size), 1);
+    memory.map_rom(first_page, mapped, cart->prg.data() + bank % banks * size, on_write, this);
+    if (mapped < pages)
+        memory.mirror(first_page + mapped, pages - mapped, first_page, mapped);
+}
+
+void Mapper::map_chr(uint16_t addr, std::size_t size, std::size_t bank){
+    const std::vector<uint8_t>& rom = chr();
+    std::size_t banks = std::max<std::size_t>(chr_banks(size), 1);
+    const uint8_t* base = rom.data() + bank % banks * size;
+    for (std::size_t i = 0; i < size / CHR_WINDOW; i++)
+        chr_windows[addr / CHR_WINDOW + i] = base + i * CHR_WINDOW % rom.size();
+}
+
+void Mapper::on_write(void* context, uint16_t addr, uint8_t value){
+    static_cast<Mapper*>(context)->write(addr, value);
+}
+
+NROM::NROM(std::shared_ptr<const Cartridge> cartridge, Mem& memory) : Mapper(std::move(cartridge), memory){
+    map_prg(0x8000, 0x8000, 0);
+    map_chr(0x0000, 0x2000, 0);
+}
+
+void NROM::write(uint16_t, uint8_t){
+}
+
+MMC1::MMC1(std::shared_ptr<const Cartridge> cartridge, Mem& memory) : Mapper(std::move(cartridge), memory){
+    memory.map_memory(0x6000 / Mem::PAGE_SIZE, prg_ram.size() / Mem::PAGE_SIZE, prg_ram.data());
+    apply();
+}
+
+MMC1::~MMC1(){
+    memory.unmap(0x6000 / Mem::PAGE_SIZE, prg_ram.size() / Mem::PAGE_SIZE);
+}
+
+void MMC1::write(uint16_t addr, uint8_t value){
+    if (value & 0x80){
+        shift = 0;
+        shift_count = 0;
+        control |= 0x0C;
+        apply();
+        return;
+    }
+    shift |= (value & 1) << shift_count;
+    if (++shift_count < 5)
+        return;
+    switch ((addr >> 13) & 3){
+        case 0: control = shift; break;
+        case 1: chr_bank[0] = shift; break;
+        case 2: chr_bank[1] = shift; break;
+        case 3: prg_bank = shift & 0x0F; break;
+    }
+    shift = 0;
+    shift_count = 0;
+    apply();
+}
+
+void MMC1::apply(){
+    switch ((control >> 2) & 3){
+        case 0:
+        case 1: // 32KB at $8000
+            map_prg(0x8000, 0x8000, prg_bank >> 1);
+            break;
+        case 2: // first bank fixed at $8000
+            map_prg(0x8000, 0x4000, 0);
+            map_prg(0xC000, 0x4000, prg_bank);
+            break;
+        case 3: // last bank fixed at $C000
+            map_prg(0x8000, 0x4000, prg_bank);
+            map_prg(0xC000, 0x4000, prg_banks(0x4000) - 1);
+            break;
+    }
+    if (control & 0x10){
+        map_chr(0x0000, 0x1000, chr_bank[0]);
+        map_chr(0x1000, 0x1000, chr_bank[1]);
+    } else {
+        map_chr(0x0000, 0x2000, chr_bank[0] >> 1);
+    }
+}
+
+UxROM::UxROM(std::shared_ptr<const Cartridge> cartridge, Mem& memory) : Mapper(std::move(cartridge), memory){
+    map_prg(0x8000, 0x4000, 0);
+    map_prg(0xC000, 0x4000, prg_banks(0x4000) - 1);
+    map_chr(0x0000, 0x2000, 0);
+}
+
+void UxROM::write(uint16_t, uint8_t value){
+    map_prg(0x8000, 0x4000, value);
+}
+
+CNROM::CNROM(std::shared_ptr<const Cartridge> cartridge, Mem& memory) : Mapper(std::move(cartridge), memory){
+    map_prg(0x8000, 0x8000, 0);
+    map_chr(0x0000, 0x2000, 0);
+}
+
+void CNROM::write(uint16_t, uint8_t value){
+    map_chr(0x0000, 0x2000, value);
+}
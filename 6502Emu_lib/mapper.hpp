@@ -0,0 +1,119 @@
+#ifndef MAPPER
+#define MAPPER
+#include "mem.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// Contents of an iNES cartridge image.
+struct Cartridge{
+    static constexpr std::size_t PRG_BANK_SIZE = 0x4000;
+    static constexpr std::size_t CHR_BANK_SIZE = 0x2000;
+
+    uint8_t mapper = 0;
+    std::vector<uint8_t> prg; /// program ROM, seen by the CPU at $8000-$FFFF
+    std::vector<uint8_t> chr; /// character ROM, seen by the PPU at $0000-$1FFF; empty if the board has CHR RAM
+
+    /// Parses an iNES image. Throws std::runtime_error if it is malformed.
+    static Cartridge from_ines(const std::vector<uint8_t>& image);
+};
+
+/** Cartridge board logic: decides which part of the cartridge is visible in each CPU and PPU address window.
+ *
+ * PRG windows are mapped into `Mem` as ROM pages pointing into the cartridge, with writes routed to the mapper's
+ * control registers. A bank switch rewrites the page pointers of the affected window; nothing is copied.
+ * The cartridge is immutable and refcounted, so any number of mappers (one per emulated machine) can show the same
+ * ROM bytes. The mapper must not outlive the memory it is attached to.
+ */
+class Mapper{
+public:
+    static const std::size_t CHR_WINDOW = 0x400; /// granularity of CHR banking
+
+    /// Creates the mapper for `cartridge` and maps it into `memory`. Throws std::runtime_error for unsupported mappers.
+    static std::unique_ptr<Mapper> create(std::shared_ptr<const Cartridge> cartridge, Mem& memory);
+    static std::unique_ptr<Mapper> create(Cartridge cartridge, Mem& memory){
+        return create(std::make_shared<const Cartridge>(std::move(cartridge)), memory);
+    }
+
+    virtual ~Mapper();
+    Mapper(const Mapper&) = delete;
+    Mapper& operator=(const Mapper&) = delete;
+
+    /// Reads CHR memory at PPU address `addr` ($0000-$1FFF) through the current banks.
+    uint8_t chr_read(uint16_t addr) const{
+        return chr_windows[addr / CHR_WINDOW % CHR_WINDOWS][addr % CHR_WINDOW];
+    }
+
+    const Cartridge& cartridge() const { return *cart; }
+
+protected:
+    static const std::size_t CHR_WINDOWS = 0x2000 / CHR_WINDOW;
+
+    std::shared_ptr<const Cartridge> cart;
+    Mem& memory;
+
+    Mapper(std::shared_ptr<const Cartridge> cartridge, Mem& memory);
+
+    /// Write to a control register, anywhere in $8000-$FFFF.
+    virtual void write(uint16_t addr, uint8_t value) = 0;
+
+    /// Number of PRG banks of `size` bytes, and the same for CHR.
+    std::size_t prg_banks(std::size_t size) const { return cart->prg.size() / size; }
+    std::size_t chr_banks(std::size_t size) const { return chr().size() / size; }
+    /// Shows PRG bank `bank` (of `size` bytes, wrapping around the ROM) at CPU address `addr`.
+    void map_prg(uint16_t addr, std::size_t size, std::size_t bank);
+    /// Shows CHR bank `bank` (of `size` bytes, wrapping around the ROM) at PPU address `addr`.
+    void map_chr(uint16_t addr, std::size_t size, std::size_t bank);
+
+private:
+    std::vector<uint8_t> chr_ram; /// used instead of `cart.chr` if the cartridge has none
+    std::array<const uint8_t*, CHR_WINDOWS> chr_windows{};
+
+    const std::vector<uint8_t>& chr() const { return cart->chr.empty() ? chr_ram : cart->chr; }
+    static void on_write(void* context, uint16_t addr, uint8_t value);
+};
+
+/// Mapper 0: no bank switching. 16KB programs are mirrored at $C000.
+class NROM : public Mapper{
+public:
+    NROM(std::shared_ptr<const Cartridge> cartridge, Mem& memory);
+protected:
+    void write(uint16_t addr, uint8_t value) override;
+};
+
+/// Mapper 1: serially loaded registers, switchable 16/32KB PRG and 4/8KB CHR banks, 8KB of PRG RAM at $6000.
+class MMC1 : public Mapper{
+public:
+    MMC1(std::shared_ptr<const Cartridge> cartridge, Mem& memory);
+    ~MMC1() override;
+protected:
+    void write(uint16_t addr, uint8_t value) override;
+private:
+    std::array<uint8_t, 0x2000> prg_ram{};
+    uint8_t shift = 0;
+    uint8_t shift_count = 0;
+    uint8_t control = 0x0C; /// PRG mode 3 (last bank fixed at $C000) after power-on
+    uint8_t chr_bank[2] = {0, 0};
+    uint8_t prg_bank = 0;
+
+    void apply();
+};
+
+/// Mapper 2: switchable 16KB PRG bank at $8000, last bank fixed at $C000.
+class UxROM : public Mapper{
+public:
+    UxROM(std::shared_ptr<const Cartridge> cartridge, Mem& memory);
+protected:
+    void write(uint16_t addr, uint8_t value) override;
+};
+
+/// Mapper 3: fixed PRG like NROM, switchable 8KB CHR bank.
+class CNROM : public Mapper{
+public:
+    CNROM(std::shared_ptr<const Cartridge> cartridge, Mem& memory);
+protected:
+    void write(uint16_t addr, uint8_t value) override;
+};
+
+#endif
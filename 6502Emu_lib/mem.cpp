@@ -0,0 +1,304 @@
+#include "mem.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+    /// What every unallocated frame reads as. Never written: pages showing it have no write pointer.
+    const Mem::Frame zero_frame;
+
+    uint8_t* frame_memory(const Mem::Frame* frame){
+        return const_cast<uint8_t*>(frame ? frame->bytes.data() : zero_frame.bytes.data());
+    }
+}
+
+Mem::Mem() : io_handlers(1){
+    dirty_pages.set();
+    unmap(0, PAGES);
+}
+
+Mem::Mem(Mem& parent, Fork)
+    : frames(parent.frames), mappings(parent.mappings), io_handlers(parent.io_handlers), aliasing(parent.aliasing),
+      dirty_pages(parent.dirty_pages){
+    for (Frame* frame : frames){
+        if (frame)
+            frame->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Both sides now share every frame, so both have to trap writes to them.
+    for (std::size_t page = 0; page < PAGES; page++){
+        update(page);
+        parent.update(page);
+    }
+}
+
+Mem::~Mem(){
+    for (Frame* frame : frames)
+        release(frame);
+}
+
+void Mem::release(Frame* frame){
+    if (frame && frame->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete frame;
+}
+
+uint8_t Mem::io_index(read_function read, write_function write, void* context){
+    IoHandler handler{read, write, context};
+    auto found = std::find(io_handlers.begin(), io_handlers.end(), handler);
+    if (found != io_handlers.end())
+        return (uint8_t)(found - io_handlers.begin());
+    if (io_handlers.size() <= UINT8_MAX){
+        io_handlers.push_back(handler);
+        return (uint8_t)(io_handlers.size() - 1);
+    }
+    // Table full: take over an entry that no page is mapped to any more.
+    std::bitset<UINT8_MAX + 1> used;
+    for (const Mapping& mapping : mappings)
+        used[mapping.io] = true;
+    for (std::size_t index = 1; index < io_handlers.size(); index++){
+        if (!used[index]){
+            io_handlers[index] = handler;
+            return (uint8_t)index;
+        }
+    }
+    throw std::runtime_error("Mem: more than 255 distinct I/O handlers mapped");
+}
+
+void Mem::map_memory(std::size_t first_page, std::size_t count, uint8_t* memory, bool writable){
+    for (std::size_t i = 0; i < count; i++){
+        Mapping mapping;
+        mapping.memory = memory + i * PAGE_SIZE;
+        mapping.writable = writable;
+        remap(first_page + i, mapping);
+    }
+}
+
+void Mem::map_rom(std::size_t first_page, std::size_t count, const uint8_t* memory, write_function write, void* context){
+    for (std::size_t i = 0; i < count; i++){
+        Mapping mapping;
+        mapping.memory = const_cast<uint8_t*>(memory + i * PAGE_SIZE); // never written: `writable` is false
+        mapping.io = io_index(nullptr, write, context);
+        remap(first_page + i, mapping);
+    }
+}
+
+void Mem::map_io(std::size_t first_page, std::size_t count, read_function read, write_function write, void* context){
+    for (std::size_t i = 0; i < count; i++){
+        Mapping mapping;
+        mapping.io = io_index(read, write, context);
+        remap(first_page + i, mapping);
+    }
+}
+
+void Mem::unmap(std::size_t first_page, std::size_t count){
+    for (std::size_t page = first_page; page < first_page + count; page++){
+        Mapping mapping;
+        mapping.memory = frame_memory(frames[page]);
+        mapping.writable = true;
+        mapping.frame = (int16_t)page;
+        remap(page, mapping);
+    }
+}
+
+void Mem::mirror(std::size_t first_page, std::size_t count, std::size_t source_page, std::size_t source_count){
+    for (std::size_t i = 0; i < count; i++)
+        remap(first_page + i, mappings[source_page + i % source_count]);
+}
+
+void Mem::set_code_page(std::size_t page, bool code){
+    code_pages[page] = code;
+    if (!aliasing || !mappings[page].memory){
+        update(page);
+        return;
+    }
+    // Mirrors have to trap writes as well.
+    for (std::size_t p = 0; p < PAGES; p++){
+        if (mappings[p].memory == mappings[page].memory)
+            update(p);
+    }
+}
+
+auto Mem::reset() -> void{
+    for (std::size_t frame = 0; frame < PAGES; frame++){
+        if (!frames[frame])
+            continue;
+        release(frames[frame]); // a fork sharing the frame keeps it
+        frames[frame] = nullptr;
+        repoint(frame);
+    }
+    for (std::size_t page = 0; page < PAGES; page++){
+        if (mappings[page].frame >= 0)
+            mark_dirty(page);
+    }
+    for (std::size_t page = 0; page < PAGES; page++){
+        if (code_pages[page])
+            discard_code(page);
+    }
+}
+
+auto Mem::allocated_pages() const -> std::size_t{
+    return std::count_if(frames.begin(), frames.end(), [](const auto& frame){ return frame != nullptr; });
+}
+
+std::bitset<Mem::PAGES> Mem::take_dirty_pages(){
+    std::bitset<PAGES> dirty = dirty_pages;
+    dirty_pages.reset();
+    for (std::size_t page = 0; page < PAGES; page++){
+        if (dirty[page])
+            update(page); // trap the next write
+    }
+    return dirty;
+}
+
+int Mem::add_watchpoint(const Watchpoint& watchpoint){
+    watchpoints.emplace_back(next_watchpoint, watchpoint);
+    update_watched_pages();
+    return next_watchpoint++;
+}
+
+void Mem::remove_watchpoint(int id){
+    std::erase_if(watchpoints, [id](const auto& entry){ return entry.first == id; });
+    update_watched_pages();
+}
+
+void Mem::update_watched_pages(){
+    std::bitset<PAGES> was_read_watched = watched_reads;
+    watched_reads.reset();
+    watched_writes.reset();
+    for (const auto& [id, watchpoint] : watchpoints){
+        for (std::size_t page = watchpoint.first / PAGE_SIZE; page <= watchpoint.last / PAGE_SIZE; page++){
+            watched_reads[page] = watched_reads[page] || watchpoint.on_read;
+            watched_writes[page] = watched_writes[page] || watchpoint.on_write;
+        }
+    }
+    for (std::size_t page = 0; page < PAGES; page++){
+        update(page);
+        // Code decoded ahead of time would skip the fetches the watchpoint has to see.
+        if (watched_reads[page] && !was_read_watched[page] && code_pages[page])
+            discard_code(page);
+    }
+}
+
+void Mem::check_watchpoints(uint16_t addr, uint8_t value, bool write) const{
+    // By index: a handler may remove watchpoints.
+    for (std::size_t i = 0; i < watchpoints.size(); i++){
+        const Watchpoint& watchpoint = watchpoints[i].second;
+        if (addr < watchpoint.first || addr > watchpoint.last || (write ? !watchpoint.on_write : !watchpoint.on_read))
+            continue;
+        if ((value & watchpoint.mask) == watchpoint.match)
+            watchpoint.handler(watchpoint.context, addr, value, write);
+    }
+}
+
+void Mem::remap(std::size_t page, const Mapping& mapping){
+    if (mappings[page] == mapping)
+        return;
+    mappings[page] = mapping;
+    if (mapping.writable && mapping.frame != (int16_t)page)
+        aliasing = true;
+    update(page);
+    // Whatever was decoded from the old contents is gone.
+    if (code_pages[page])
+        discard_code(page);
+}
+
+void Mem::discard_code(std::size_t page){
+    for (std::size_t addr = page * PAGE_SIZE; addr < (page + 1) * PAGE_SIZE; addr++)
+        code_write_handler(code_write_context, addr);
+}
+
+void Mem::update(std::size_t page){
+    const Mapping& mapping = mappings[page];
+    pages[page].read = watched_reads[page] ? nullptr : mapping.memory;
+    bool direct = mapping.writable && dirty_pages[page] && !watched_writes[page] && !shared(page) && !holds_code(page);
+    pages[page].write = direct ? mapping.memory : nullptr;
+}
+
+void Mem::copy_frame(std::size_t frame){
+    Frame* copy = new Frame;
+    if (frames[frame]){
+        copy->bytes = frames[frame]->bytes;
+        release(frames[frame]);
+        copied_pages++;
+    }
+    frames[frame] = copy;
+    repoint(frame);
+}
+
+void Mem::repoint(std::size_t frame){
+    for (std::size_t page = 0; page < PAGES; page++){
+        if (mappings[page].frame != (int16_t)frame)
+            continue;
+        mappings[page].memory = frame_memory(frames[frame]);
+        update(page);
+    }
+}
+
+void Mem::mark_dirty(std::size_t page){
+    const uint8_t* memory = mappings[page].memory;
+    if (!aliasing || !memory){
+        dirty_pages[page] = true;
+        update(page);
+        return;
+    }
+    for (std::size_t p = 0; p < PAGES; p++){
+        if (mappings[p].memory == memory && !dirty_pages[p]){
+            dirty_pages[p] = true;
+            update(p);
+        }
+    }
+}
+
+bool Mem::holds_code(std::size_t page) const{
+    if (code_pages[page])
+        return true;
+    if (!aliasing || !mappings[page].memory)
+        return false;
+    for (std::size_t p = 0; p < PAGES; p++){
+        if (code_pages[p] && mappings[p].memory == mappings[page].memory)
+            return true;
+    }
+    return false;
+}
+
+void Mem::notify_code_write(uint16_t addr){
+    std::size_t index = addr / PAGE_SIZE;
+    const uint8_t* memory = mappings[index].memory;
+    if (!aliasing || !memory){
+        if (code_pages[index])
+            code_write_handler(code_write_context, addr);
+        return;
+    }
+    for (std::size_t p = 0; p < PAGES; p++){
+        if (code_pages[p] && mappings[p].memory == memory)
+            code_write_handler(code_write_context, p * PAGE_SIZE + addr % PAGE_SIZE);
+    }
+}
+
+uint8_t Mem::read_slow(uint16_t addr) const{
+    std::size_t index = addr / PAGE_SIZE;
+    const Mapping& page = mappings[index];
+    IoHandler io = io_handlers[page.io]; // by value: the callback may remap pages and grow `io_handlers`
+    uint8_t value = page.memory ? page.memory[addr % PAGE_SIZE] : io.read ? io.read(io.context, addr) : 0;
+    if (watched_reads[index])
+        check_watchpoints(addr, value, false);
+    return value;
+}
+
+void Mem::write_slow(uint16_t addr, uint8_t value){
+    std::size_t index = addr / PAGE_SIZE;
+    const Mapping& page = mappings[index];
+    if (page.writable){
+        if (shared(index))
+            copy_frame(page.frame);
+        else if (page.frame >= 0)
+            update(index); // the fork may have copied the frame away, leaving it to us alone
+        // After the copy: every unallocated page shows the zero page, but only this one is being written.
+        if (!dirty_pages[index])
+            mark_dirty(index);
+        page.memory[addr % PAGE_SIZE] = value;
+        notify_code_write(addr);
+    } else if (IoHandler io = io_handlers[page.io]; io.write){
+        io.write(io.context, addr, value);
+    }
+    if (watched_writes[index])
+        check_watchpoints(addr, value, true);
+}
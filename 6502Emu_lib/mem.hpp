@@ -1,28 +1,216 @@
 #include <cstdint>
 #include <cstdlib>
 #include <array>
+#include <atomic>
+#include <bitset>
+#include <optional>
+#include <vector>
 
 #ifndef MEMORY
 #define MEMORY
 
+/** The CPU's view of the address space.
+ *
+ * Every 256-byte page is described by an entry in `mappings`. A page is either backed by host memory (RAM or ROM)
+ * or by an I/O device's read/write callbacks. Accesses to host memory go straight through the page's `read` and
+ * `write` pointers without any bounds check; everything else (I/O, writes to ROM, writes into pages holding
+ * predecoded code) takes the out-of-line slow path. Mirrors are pages pointing at the same host memory.
+ *
+ * RAM is held in one refcounted frame per page; unless remapped, page N is backed by `frames[N]`. A forked Mem
+ * shares its parent's frames, and whichever side writes to a shared frame first gets its own copy of it.
+ * Frames are allocated on the first write: until then a page reads from a zero page shared by every Mem, which
+ * keeps a Mem that only touches a few pages small. The Mem itself stays around 10KB: a page's I/O callbacks live
+ * in `io_handlers` and its mapping only holds their index.
+ *
+ * `dirty_pages` records which pages have been written since it was last cleared. A clean page has no fast write
+ * pointer, so only the first write to it after a clear takes the slow path.
+ *
+ * Watchpoints work the same way: only pages containing a watched address lose their fast pointers, and the slow
+ * path compares the exact address. With no watchpoints set, nothing is checked at all.
+ */
 struct Mem{
     public:
     static const std::size_t MEM_LEN = 0x10000;
-    std::array<uint8_t, MEM_LEN> data;
+    static const std::size_t PAGE_SIZE = 0x100;
+    static const std::size_t PAGES = MEM_LEN / PAGE_SIZE;
+    using code_write_function = void(*)(void* context, uint16_t addr);
+    using read_function = uint8_t(*)(void* context, uint16_t addr);
+    using write_function = void(*)(void* context, uint16_t addr, uint8_t value);
+    using watch_function = void(*)(void* context, uint16_t addr, uint8_t value, bool write);
 
-    auto get(std::size_t index) const -> uint8_t{
-        return data.at(index);
+    /// Fast-path pointers of a page, derived from its `Mapping`.
+    struct Page{
+        uint8_t* read = nullptr;  /// null if reads go through the slow path
+        uint8_t* write = nullptr; /// null if writes go through the slow path
+    };
+    /// What a page is mapped to.
+    struct Mapping{
+        uint8_t* memory = nullptr; /// host memory behind the page, null for I/O pages
+        bool writable = false; /// whether writes reach `memory`; ROM sends them to its I/O write callback
+        uint8_t io = 0; /// index into `io_handlers`, 0 for none
+        int16_t frame = -1; /// index into `frames` if `memory` is one of them, -1 for memory mapped from outside
+
+        bool operator==(const Mapping&) const = default;
+    };
+    /// Callbacks of an I/O device, or of the registers behind a ROM. Either may be null.
+    struct IoHandler{
+        read_function read = nullptr;
+        write_function write = nullptr;
+        void* context = nullptr;
+
+        bool operator==(const IoHandler&) const = default;
+    };
+
+    /// 256 bytes of RAM, shared between forks by reference count.
+    struct Frame{
+        std::array<uint8_t, PAGE_SIZE> bytes{};
+        std::atomic<uint32_t> refs{1}; /// number of Mems holding the frame
+    };
+    /// Calls `handler` when an address in `first`-`last` is read or written with a value for which
+    /// `(value & mask) == match`. The default mask matches any value. Addresses are CPU addresses, so a mirror of a
+    /// watched address is not watched. Instruction fetches count as reads.
+    struct Watchpoint{
+        uint16_t first = 0;
+        uint16_t last = 0;
+        bool on_read = false;
+        bool on_write = true;
+        uint8_t mask = 0;
+        uint8_t match = 0;
+        watch_function handler = nullptr; /// receives the byte read or written, after the access
+        void* context = nullptr;
+    };
+    /// Tag selecting the forking constructor.
+    struct Fork{};
+
+    /// Null for frames that have not been written since the last reset; they read as zero. Each non-null entry
+    /// holds one reference.
+    std::array<Frame*, PAGES> frames{};
+    std::array<Page, PAGES> pages;
+    std::array<Mapping, PAGES> mappings;
+    /// Distinct callbacks used by the mappings, entry 0 being none. Entries no mapping uses any more are reused.
+    std::vector<IoHandler> io_handlers;
+    /// Pages holding predecoded code. Writes into them are reported to `code_write_handler`. Change with `set_code_page`.
+    std::bitset<PAGES> code_pages;
+    code_write_function code_write_handler = nullptr;
+    void* code_write_context = nullptr;
+    /// Whether any page may share host memory with another one. Until then, code tracking can skip looking for mirrors.
+    bool aliasing = false;
+    /// Shared frames this Mem has copied before writing to them. Allocating a frame for the zero page does not count.
+    std::size_t copied_pages = 0;
+    /// Pages written to since the last `take_dirty_pages`; a write through a mirror marks every page it is visible
+    /// in. Everything starts out dirty. Writes to ROM and I/O pages do not count.
+    std::bitset<PAGES> dirty_pages;
+
+    Mem();
+    /// Copy-on-write copy of `parent`. RAM frames are shared until either side writes to them; ROM, I/O and memory
+    /// mapped with `map_memory` are shared as they are. Code pages and watchpoints are not inherited.
+    Mem(Mem& parent, Fork);
+    // A plain copy would leave both sides writing to the same frames.
+    Mem(const Mem&) = delete;
+    Mem& operator=(const Mem&) = delete;
+    ~Mem();
+
+    auto get(uint16_t addr) const -> uint8_t{
+        const Page& page = pages[addr / PAGE_SIZE];
+        if (page.read) [[likely]]
+            return page.read[addr % PAGE_SIZE];
+        return read_slow(addr);
+    }
+
+    auto set(uint16_t addr, uint8_t value) -> void{
+        const Page& page = pages[addr / PAGE_SIZE];
+        if (page.write) [[likely]]
+            page.write[addr % PAGE_SIZE] = value;
+        else
+            write_slow(addr, value);
     }
 
-    auto set(std::size_t index, uint8_t value) -> void{
-        data.at(index) = value;
+    /// Byte at `addr` if it can be read without side effects: its page is backed by host memory and has no read
+    /// watchpoint. Neither I/O callbacks nor watchpoints are called. Lets code be decoded ahead of running it.
+    auto peek(uint16_t addr) const -> std::optional<uint8_t>{
+        const Mapping& mapping = mappings[addr / PAGE_SIZE];
+        if (!mapping.memory || watched_reads[addr / PAGE_SIZE])
+            return std::nullopt;
+        return mapping.memory[addr % PAGE_SIZE];
     }
-    /// Sets everything in memory to 0.
-    auto reset() {
-        for (auto& byte: data){
-            byte = 0;
-        }
+
+    /// Maps `count` pages starting at `first_page` to consecutive host memory at `memory`, which must hold
+    /// `count * PAGE_SIZE` bytes and outlive the mapping. Writes to a page that is not `writable` are ignored.
+    /// Remapping a page drops any code predecoded from it.
+    void map_memory(std::size_t first_page, std::size_t count, uint8_t* memory, bool writable = true);
+    /// Maps `count` pages starting at `first_page` read-only to `memory`, sending writes to `write` instead
+    /// (cartridge ROM with mapper registers behind it). `write` may be null.
+    void map_rom(std::size_t first_page, std::size_t count, const uint8_t* memory, write_function write = nullptr,
+                 void* context = nullptr);
+    /// Routes every access to `count` pages starting at `first_page` to an I/O device. Either callback may be
+    /// null; reads then return 0 and writes are ignored.
+    void map_io(std::size_t first_page, std::size_t count, read_function read, write_function write, void* context);
+    /// Maps `count` pages starting at `first_page` back to their own RAM frames.
+    void unmap(std::size_t first_page, std::size_t count);
+    /// Makes `count` pages starting at `first_page` repeat the `source_count` pages starting at `source_page`,
+    /// e.g. `mirror(0x08, 0x18, 0x00, 0x08)` for 2KB of RAM mirrored up to $1FFF. Mirrors share the source's host
+    /// memory or I/O callbacks, so they cost the same as the source. Remapping the source does not move its mirrors.
+    void mirror(std::size_t first_page, std::size_t count, std::size_t source_page, std::size_t source_count);
+
+    /// Byte of RAM behind `addr`, whatever the page is currently mapped to.
+    auto ram(uint16_t addr) const -> uint8_t{
+        const auto& frame = frames[addr / PAGE_SIZE];
+        return frame ? frame->bytes[addr % PAGE_SIZE] : 0;
+    }
+    /// Number of frames this Mem holds, shared or not.
+    auto allocated_pages() const -> std::size_t;
+
+    /// Flags `page` as holding (or no longer holding) predecoded code.
+    void set_code_page(std::size_t page, bool code);
+
+    /// Sets all RAM to 0 by dropping every frame.
+    auto reset() -> void;
+
+    /// Adds a watchpoint and returns an id for `remove_watchpoint`.
+    int add_watchpoint(const Watchpoint& watchpoint);
+    void remove_watchpoint(int id);
+
+    /// Returns `dirty_pages` and marks every page clean, e.g. to copy only the changed pages into an incremental
+    /// snapshot.
+    std::bitset<PAGES> take_dirty_pages();
+
+    private:
+    std::vector<std::pair<int, Watchpoint>> watchpoints;
+    int next_watchpoint = 0;
+    /// Pages with a watchpoint on reads or writes; their accesses take the slow path.
+    std::bitset<PAGES> watched_reads;
+    std::bitset<PAGES> watched_writes;
+
+    void remap(std::size_t page, const Mapping& mapping);
+    /// Recomputes the fast-path pointers of `page` from its mapping.
+    void update(std::size_t page);
+    /// Whether the RAM frame behind `page` is shared with a fork or still the zero page.
+    bool shared(std::size_t page) const{
+        int16_t frame = mappings[page].frame;
+        return frame >= 0 && (!frames[frame] || frames[frame]->refs.load(std::memory_order_acquire) > 1);
     }
+    /// Index of the `io_handlers` entry for these callbacks, adding one if needed.
+    uint8_t io_index(read_function read, write_function write, void* context);
+    /// Drops this Mem's reference to `frame`, freeing it if it was the last one.
+    static void release(Frame* frame);
+    /// Gives this Mem its own copy of `frame` (a new zero-filled one if it has none) and points every page mapping it
+    /// at the copy.
+    void copy_frame(std::size_t frame);
+    /// Points every page mapping `frame` at its current memory.
+    void repoint(std::size_t frame);
+    /// Marks `page` and every page sharing its host memory as dirty.
+    void mark_dirty(std::size_t page);
+    /// Reports every address of `page` as written.
+    void discard_code(std::size_t page);
+    /// Whether `page` or a page sharing its host memory holds predecoded code.
+    bool holds_code(std::size_t page) const;
+    /// Reports a write to `addr` for every code page that shares the written host memory.
+    void notify_code_write(uint16_t addr);
+    /// Recomputes `watched_reads` and `watched_writes` after watchpoints were added or removed.
+    void update_watched_pages();
+    void check_watchpoints(uint16_t addr, uint8_t value, bool write) const;
+    uint8_t read_slow(uint16_t addr) const;
+    void write_slow(uint16_t addr, uint8_t value);
 };
 
-#endif
\ No newline at end of file
+#endif
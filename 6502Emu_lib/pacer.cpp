@@ -0,0 +1,81 @@
+#include "pacer.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <fmt/format.h>
+#include <thread>
+
+Pacer::Pacer(Cpu& cpu, double batch_seconds) : cpu(cpu){
+    batch = std::max<cycles>(1, (cycles)cpu.cycles_in(batch_seconds));
+    restart();
+}
+
+void Pacer::restart(){
+    anchor_time = clock::now();
+    anchor_cycle = cpu.cycle_count;
+}
+
+void Pacer::set_pacing(Pacing pacing, double speed){
+    if (pacing == Pacing::multiplier && !(speed > 0))
+        throw std::runtime_error(fmt::format("Speed multiplier must be positive, got {}", speed));
+    mode = pacing;
+    multiplier = speed;
+    restart(); // the new speed applies from here, not retroactively
+}
+
+auto Pacer::speed() const -> double{
+    switch (mode){
+        case Pacing::realtime: return 1.0;
+        case Pacing::multiplier: return multiplier;
+        default: return 0.0;
+    }
+}
+
+auto Pacer::deadline() const -> clock::time_point{
+    if (mode == Pacing::unlimited)
+        return clock::now();
+    double seconds = (double)(cpu.cycle_count - anchor_cycle) / cpu.frequency / speed();
+    return anchor_time + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+}
+
+void Pacer::run_batch(){
+    cpu.run_for(batch);
+    stats.batches++;
+    if (mode == Pacing::unlimited)
+        return;
+    clock::time_point due = deadline();
+    clock::time_point now = clock::now();
+    if (now <= due){
+        wait_until(due);
+        return;
+    }
+    clock::duration late = now - due;
+    stats.late_batches++;
+    stats.total_lateness += late;
+    stats.max_lateness = std::max(stats.max_lateness, late);
+    if (late > max_lag){
+        stats.resyncs++;
+        restart();
+    }
+}
+
+void Pacer::run_for(double seconds){
+    cycle_timestamp end = cpu.cycle_count + cpu.cycles_in(seconds);
+    while (cpu.cycle_count < end)
+        run_batch();
+}
+
+bool Pacer::present_due(){
+    if (mode == Pacing::realtime)
+        return true;
+    clock::time_point now = clock::now();
+    if (now - last_present < present_interval)
+        return false;
+    last_present = now;
+    return true;
+}
+
+void Pacer::wait_until(clock::time_point deadline) const{
+    std::this_thread::sleep_until(deadline - spin);
+    while (clock::now() < deadline)
+        std::this_thread::yield();
+}
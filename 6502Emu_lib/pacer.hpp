@@ -0,0 +1,77 @@
+#ifndef PACER
+#define PACER
+#include "cpu.hpp"
+#include <chrono>
+
+/** Runs a Cpu in step with the wall clock at `Cpu::frequency`, at a multiple of it, or as fast as the host allows.
+ *
+ * Emulation runs in batches (a millisecond of cycles, or a frame), and between batches the host thread sleeps until
+ * the wall-clock time at which the emulated time reached is due. Deadlines are taken from one anchor rather than from
+ * the previous batch, so oversleeping is paid back by the following batches instead of adding up. Only the last
+ * `spin` before a deadline is busy-waited, which keeps the host core mostly idle.
+ *
+ * If the host falls more than `max_lag` behind (a breakpoint, a suspended process), the pacer starts over from the
+ * current time instead of running flat out until it has caught up.
+ *
+ * The pacing can be switched at any time. Outside real time, the host should not render or output audio for every
+ * batch; `present_due` says which ones are worth presenting.
+ */
+class Pacer{
+public:
+    using clock = std::chrono::steady_clock;
+
+    enum class Pacing{
+        realtime,   /// at `Cpu::frequency`
+        multiplier, /// at `speed` times `Cpu::frequency`
+        unlimited,  /// as fast as the host allows, never waiting
+    };
+
+    /// How far batches ended up behind their deadlines, i.e. the host could not keep up.
+    struct Stats{
+        std::size_t batches = 0;
+        std::size_t late_batches = 0;
+        clock::duration total_lateness{};
+        clock::duration max_lateness{};
+        std::size_t resyncs = 0; /// times the pacer gave up catching up, see `max_lag`
+    };
+
+    clock::duration spin = std::chrono::microseconds(50);
+    clock::duration max_lag = std::chrono::milliseconds(100);
+    /// Shortest wall-clock time between two batches `present_due` accepts outside real time.
+    clock::duration present_interval = std::chrono::microseconds(16667);
+    Stats stats;
+
+    /// Paces `cpu` in real time, in batches of `batch_seconds` of emulated time.
+    explicit Pacer(Cpu& cpu, double batch_seconds = 0.001);
+
+    /// Switches the pacing from the next batch on. `speed` is only used by `Pacing::multiplier` and must be positive.
+    void set_pacing(Pacing mode, double speed = 1.0);
+    auto pacing() const -> Pacing { return mode; }
+    /// Emulated seconds per wall-clock second; 0 when unlimited.
+    auto speed() const -> double;
+
+    /// Runs one batch, then waits until the wall clock has caught up with it.
+    void run_batch();
+    /// Runs batches until `seconds` of emulated time have passed.
+    void run_for(double seconds);
+    /// Starts pacing again from the current time, e.g. after emulation was paused. Does not reset `stats`.
+    void restart();
+    /// Wall-clock time at which the cycle count currently reached is due; always now when unlimited.
+    auto deadline() const -> clock::time_point;
+    /// Whether the host should render and output audio for the batch just run: always in real time, otherwise at
+    /// most once per `present_interval`. Skipped batches should be dropped rather than queued.
+    bool present_due();
+
+private:
+    Cpu& cpu;
+    cycles batch;
+    clock::time_point anchor_time;
+    cycle_timestamp anchor_cycle;
+    Pacing mode = Pacing::realtime;
+    double multiplier = 1.0;
+    clock::time_point last_present;
+
+    void wait_until(clock::time_point deadline) const;
+};
+
+#endif
@@ -0,0 +1,28 @@
+#include "profile.hpp"
+#include "instruction.hpp"
+#include <algorithm>
+#include <fmt/format.h>
+
+std::string OpcodePairProfile::Entry::to_string() const {
+    const InstructionInfo& a = instruction_info.get(first);
+    const InstructionInfo& b = instruction_info.get(second);
+    return fmt::format("{:02X} {:02X}  {} -> {}: {}", first, second, a.to_string(), b.to_string(), count);
+}
+
+std::vector<OpcodePairProfile::Entry> OpcodePairProfile::top(std::size_t n) const {
+    std::vector<Entry> entries;
+    for (std::size_t pair = 0; pair < counts.size(); pair++){
+        if (counts[pair])
+            entries.push_back({(uint8_t)(pair >> 8), (uint8_t)pair, counts[pair]});
+    }
+    n = std::min(n, entries.size());
+    std::partial_sort(entries.begin(), entries.begin() + n, entries.end(),
+                      [](const Entry& a, const Entry& b){ return a.count > b.count; });
+    entries.resize(n);
+    return entries;
+}
+
+void OpcodePairProfile::reset() {
+    counts.fill(0);
+    previous = -1;
+}
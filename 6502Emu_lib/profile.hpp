@@ -0,0 +1,34 @@
+#ifndef PROFILE
+#define PROFILE
+#include "types.h"
+#include <array>
+#include <string>
+#include <vector>
+
+/// Counts how often each opcode is directly followed by each other opcode.
+/// Used on a representative workload to choose which pairs get superinstructions.
+struct OpcodePairProfile{
+    struct Entry{
+        uint8_t first;
+        uint8_t second;
+        uint64_t count;
+
+        std::string to_string() const;
+    };
+
+    std::array<uint64_t, 0x10000> counts{}; /// indexed by first << 8 | second
+    int previous = -1; /// last recorded opcode, or -1 before the first one
+
+    /// Records that `opcode` is about to execute.
+    auto record(uint8_t opcode) -> void {
+        if (previous >= 0)
+            counts[previous << 8 | opcode]++;
+        previous = opcode;
+    }
+
+    /// The `n` most frequent pairs, most frequent first.
+    std::vector<Entry> top(std::size_t n) const;
+    void reset();
+};
+
+#endif
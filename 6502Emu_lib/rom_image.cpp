@@ -0,0 +1,96 @@
+#include "rom_image.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <fmt/format.h>
+
+#if ENABLE_ROM_MMAP
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#include <iterator>
+#endif
+
+RomImage::RomImage(const std::string& path){
+    #if ENABLE_ROM_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error(fmt::format("cannot open ROM {}: {}", path, std::strerror(errno)));
+    struct stat info;
+    if (fstat(fd, &info) != 0){
+        int error = errno;
+        close(fd);
+        throw std::runtime_error(fmt::format("cannot stat ROM {}: {}", path, std::strerror(error)));
+    }
+    length = (std::size_t)info.st_size;
+    if (length > 0){
+        // The mapping covers whole host pages; the bytes past the end of the file read as zeros.
+        std::size_t host_page = (std::size_t)sysconf(_SC_PAGESIZE);
+        mapped_length = (length + host_page - 1) / host_page * host_page;
+        void* mapping = mmap(nullptr, mapped_length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED){
+            int error = errno;
+            close(fd);
+            throw std::runtime_error(fmt::format("cannot map ROM {}: {}", path, std::strerror(error)));
+        }
+        bytes = static_cast<const uint8_t*>(mapping);
+    }
+    close(fd); // the mapping keeps the file referenced
+    #else
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw std::runtime_error(fmt::format("cannot open ROM {}", path));
+    copy.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    length = copy.size();
+    // Pad like a mapping would be, with room for one page mapped from an unaligned offset.
+    copy.resize((length + Mem::PAGE_SIZE - 1) / Mem::PAGE_SIZE * Mem::PAGE_SIZE + Mem::PAGE_SIZE);
+    bytes = copy.data();
+    mapped_length = copy.size();
+    #endif
+}
+
+RomImage::~RomImage(){
+    release();
+}
+
+RomImage::RomImage(RomImage&& other) noexcept{
+    *this = std::move(other);
+}
+
+RomImage& RomImage::operator=(RomImage&& other) noexcept{
+    if (this == &other)
+        return *this;
+    release();
+    bytes = std::exchange(other.bytes, nullptr);
+    length = std::exchange(other.length, 0);
+    mapped_length = std::exchange(other.mapped_length, 0);
+    copy = std::move(other.copy);
+    return *this;
+}
+
+void RomImage::map(Mem& memory, uint16_t addr, std::size_t offset, std::size_t size) const{
+    if (offset > length)
+        throw std::runtime_error(fmt::format("ROM offset {:#x} is past the end of the image ({:#x} bytes)", offset, length));
+    size = std::min(size, length - offset);
+    std::size_t pages = (size + Mem::PAGE_SIZE - 1) / Mem::PAGE_SIZE;
+    if (addr % Mem::PAGE_SIZE != 0 || addr / Mem::PAGE_SIZE + pages > Mem::PAGES
+        || offset + pages * Mem::PAGE_SIZE > mapped_length)
+        throw std::runtime_error(fmt::format("cannot map {:#x} bytes of ROM at ${:04X}", size, addr));
+    memory.map_rom(addr / Mem::PAGE_SIZE, pages, bytes + offset);
+}
+
+void RomImage::release(){
+    #if ENABLE_ROM_MMAP
+    if (mapped_length && copy.empty())
+        munmap(const_cast<uint8_t*>(bytes), mapped_length);
+    #endif
+    bytes = nullptr;
+    length = 0;
+    mapped_length = 0;
+    copy.clear();
+}
@@ -0,0 +1,51 @@
+#ifndef ROM_IMAGE
+#define ROM_IMAGE
+#include "mem.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef ENABLE_ROM_MMAP
+#if defined(__unix__) || defined(__APPLE__)
+#define ENABLE_ROM_MMAP 1
+#else
+#define ENABLE_ROM_MMAP 0 // read the file into memory instead
+#endif
+#endif
+
+/** A ROM file mapped read-only into the host's address space.
+ *
+ * Opening an image does not read it; pages are faulted in from the page cache as the CPU touches them, and every
+ * process mapping the same file shares one copy. `map` points `Mem` pages straight at the file mapping.
+ * An image is never written to; machines in the same process can share one through `std::shared_ptr<const RomImage>`.
+ */
+class RomImage{
+public:
+    /// Maps the file at `path`. Throws std::runtime_error if it cannot be opened or mapped.
+    explicit RomImage(const std::string& path);
+    ~RomImage();
+    RomImage(RomImage&& other) noexcept;
+    RomImage& operator=(RomImage&& other) noexcept;
+    RomImage(const RomImage&) = delete;
+    RomImage& operator=(const RomImage&) = delete;
+
+    const uint8_t* data() const { return bytes; }
+    std::size_t size() const { return length; }
+
+    /// Maps `size` bytes of the image starting at `offset` (all of it by default) read-only at the page-aligned
+    /// address `addr`. A partial last page reads as zeros past the end of the file. The image must stay alive
+    /// for as long as the pages are mapped. Throws std::runtime_error if the range does not fit, which can only
+    /// happen for an unaligned `offset` close to the end of the file.
+    void map(Mem& memory, uint16_t addr, std::size_t offset = 0, std::size_t size = SIZE_MAX) const;
+
+private:
+    const uint8_t* bytes = nullptr;
+    std::size_t length = 0;
+    std::size_t mapped_length = 0; /// readable bytes at `bytes`: the file plus zero padding
+    std::vector<uint8_t> copy; /// file contents when ENABLE_ROM_MMAP is off
+
+    void release();
+};
+
+#endif
@@ -0,0 +1,26 @@
+#include "scheduler.hpp"
+#include <algorithm>
+
+Scheduler::event_id Scheduler::schedule(cycle_timestamp due, event_function handler, void* context){
+    events.push_back({due, next_id, handler, context});
+    std::push_heap(events.begin(), events.end());
+    return next_id++;
+}
+
+bool Scheduler::cancel(event_id id){
+    auto event = std::find_if(events.begin(), events.end(), [id](const Event& e){ return e.id == id; });
+    if (event == events.end())
+        return false;
+    events.erase(event);
+    std::make_heap(events.begin(), events.end());
+    return true;
+}
+
+void Scheduler::fire_due(cycle_timestamp now){
+    while (!events.empty() && events.front().due <= now){
+        std::pop_heap(events.begin(), events.end());
+        Event event = events.back();
+        events.pop_back(); // before the handler runs, since it may schedule more
+        event.handler(event.context, event.due);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef SCHEDULER
+#define SCHEDULER
+#include "types.h"
+#include <cstdint>
+#include <vector>
+
+/** Future device events (timer expiry, end of a scanline, the next audio sample), keyed by the absolute cycle they are
+ * due at.
+ *
+ * The run loop executes CPU code uninterrupted up to `next()` and then calls `fire_due`, so devices cost nothing
+ * between their events. Events are kept in a binary heap.
+ */
+class Scheduler{
+public:
+    /// Called once `due` has been reached. `Cpu::cycle_count` is current and may be past `due` by part of an
+    /// instruction. The handler may schedule further events, including a repeat of itself.
+    using event_function = void(*)(void* context, cycle_timestamp due);
+    using event_id = uint64_t;
+    static constexpr cycle_timestamp NEVER = UINT64_MAX;
+
+    /// Adds an event due at `due`. Returns an id for `cancel`.
+    event_id schedule(cycle_timestamp due, event_function handler, void* context);
+    /// Removes a pending event. Returns false if it has already fired or was never scheduled.
+    bool cancel(event_id id);
+
+    /// Timestamp of the earliest pending event, or NEVER.
+    auto next() const -> cycle_timestamp {
+        return events.empty() ? NEVER : events.front().due;
+    }
+    auto pending() const -> std::size_t {
+        return events.size();
+    }
+    /// Fires every event due at or before `now`, earliest first; events due at the same cycle fire in the order
+    /// they were scheduled.
+    void fire_due(cycle_timestamp now);
+
+private:
+    struct Event{
+        cycle_timestamp due;
+        event_id id;
+        event_function handler;
+        void* context;
+
+        /// Heap order: the earliest event, then the oldest, ends up at the front.
+        bool operator<(const Event& other) const {
+            return due != other.due ? due > other.due : id > other.id;
+        }
+    };
+
+    std::vector<Event> events; /// binary heap, see `Event::operator<`
+    event_id next_id = 0;
+};
+
+#endif
@@ -1,14 +1,16 @@
 //
 // Created by toast on 5/28/21.
 //
-#include <functional>
+#include <cstdint>
 
 #ifndef INC_6502EMU_TYPES_H
 #define INC_6502EMU_TYPES_H
 
 using cycles = unsigned int;
+using cycle_timestamp = uint64_t; // absolute cycle count since power-on
+using operands = uint16_t; // operand bytes of an instruction (little-endian), fetched before its handler runs
 template<typename T>
-using instruction_function = std::function<cycles(T)>;
+using instruction_function = cycles(*)(T, operands); // plain function pointer, so the opcode table can be built at compile time.
 
 enum AddressingMode{
     INDIRECT_X,
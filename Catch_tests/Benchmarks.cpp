@@ -0,0 +1,73 @@
+//
+// Throughput benchmarks. Hidden from the default run; run with `Catch_tests_run "[!benchmark]"`.
+//
+
+#include "catch.hpp"
+#include <instruction.hpp>
+
+namespace {
+    void nop_watch(void*, uint16_t, uint8_t, bool){
+    }
+}
+
+TEST_CASE("Interpreter throughput with watchpoints", "[!benchmark]") {
+    const cycles BUDGET = 1000000;
+    Cpu cpu;
+    cpu.program_write({0xA5, 0x10,        // LDA $10
+                       0x69, 0x01,        // ADC #$01
+                       0x8D, 0x00, 0x02,  // STA $0200
+                       0xE8,              // INX
+                       0x4C, 0x00, 0x06}); // JMP $0600
+
+    BENCHMARK("no watchpoints") {
+        return cpu.run_for(BUDGET);
+    };
+
+    Mem::Watchpoint watch;
+    watch.on_read = true;
+    watch.handler = nop_watch;
+    watch.first = watch.last = 0x4000;
+    int id = cpu.memory.add_watchpoint(watch);
+    BENCHMARK("watchpoint on an untouched page") {
+        return cpu.run_for(BUDGET);
+    };
+    cpu.memory.remove_watchpoint(id);
+
+    watch.first = watch.last = 0x0280;
+    cpu.memory.add_watchpoint(watch);
+    BENCHMARK("watchpoint on the page being stored to") {
+        return cpu.run_for(BUDGET);
+    };
+}
+
+TEST_CASE("JIT throughput", "[!benchmark]") {
+    const cycles BUDGET = 1000000;
+    // loop: LDA #$10; ADC #$01; AND #$7F; EOR #$55; TAX; INX; TXA; CLC; JMP loop
+    const uint8_t alu[] = {0xA9, 0x10, 0x69, 0x01, 0x29, 0x7F, 0x49, 0x55, 0xAA, 0xE8, 0x8A, 0x18,
+                           0x4C, 0x00, 0x06};
+    // loop: LDA $10; STA $11; LDX $12; STX $13; INC $14; JMP loop
+    const uint8_t handlers[] = {0xA5, 0x10, 0x85, 0x11, 0xA6, 0x12, 0x86, 0x13, 0xE6, 0x14, 0x4C, 0x00, 0x06};
+
+    Cpu cached_alu, jit_alu, cached_handlers, jit_handlers;
+    cached_alu.program_write(alu);
+    jit_alu.program_write(alu);
+    cached_handlers.program_write(handlers);
+    jit_handlers.program_write(handlers);
+    cached_alu.enable_block_cache();
+    cached_handlers.enable_block_cache();
+    if (!jit_alu.enable_jit() || !jit_handlers.enable_jit())
+        return; // no JIT on this host
+
+    BENCHMARK("ALU block, block cache") {
+        return cached_alu.run_for(BUDGET);
+    };
+    BENCHMARK("ALU block, JIT") {
+        return jit_alu.run_for(BUDGET);
+    };
+    BENCHMARK("handler-only block, block cache") {
+        return cached_handlers.run_for(BUDGET);
+    };
+    BENCHMARK("handler-only block, JIT") {
+        return jit_handlers.run_for(BUDGET);
+    };
+}
@@ -0,0 +1,616 @@
+//
+// Cycle accounting and run loop tests.
+//
+
+#include "catch.hpp"
+#include <device.hpp>
+#include <instruction.hpp>
+#include <jit.hpp>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Global allocation counter, used to check that the execution path never touches the heap.
+static std::size_t allocation_count = 0;
+
+void* operator new(std::size_t size) {
+    allocation_count++;
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+/// Whether every byte of RAM is the same in both.
+static bool same_memory(const Mem& a, const Mem& b) {
+    for (uint32_t addr = 0; addr < Mem::MEM_LEN; addr++){
+        if (a.ram(addr) != b.ram(addr))
+            return false;
+    }
+    return true;
+}
+
+TEST_CASE("Cycle counting", "[CpuTests]") {
+    Cpu cpu;
+    cpu.program_write({0xA9, 0x01, 0x85, 0x10, 0xA6, 0x10, 0xBD, 0xFF, 0x02});
+    REQUIRE(cpu.cycle_count == 0);
+    REQUIRE(cpu.execute_instruction() == 2); // LDA #$01
+    REQUIRE(cpu.execute_instruction() == 3); // STA $10
+    REQUIRE(cpu.execute_instruction() == 3); // LDX $10
+    REQUIRE(cpu.execute_instruction() == 5); // LDA $02FF,X (page crossed)
+    REQUIRE(cpu.cycle_count == 13);
+}
+
+TEST_CASE("Run for a cycle budget", "[CpuTests]") {
+    Cpu cpu;
+    cpu.program_write({0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA, 0xEA});
+    REQUIRE(cpu.run_for(9) == 10); // 5 NOPs, overshooting the budget by one cycle
+    REQUIRE(cpu.PC == 0x0605);
+    REQUIRE(cpu.cycle_count == 10);
+    REQUIRE(cpu.run_until(14) == 14); // 2 NOPs
+    REQUIRE(cpu.PC == 0x0607);
+    REQUIRE(cpu.run_until(14) == 14); // already there, nothing runs
+    REQUIRE(cpu.PC == 0x0607);
+}
+
+TEST_CASE("Run loop matches single stepping", "[CpuTests]") {
+    // LDX #$00; loop: INX; STX $0200; CPX #$10; BNE loop; JMP $0600
+    const uint8_t program[] = {0xA2, 0x00, 0xE8, 0x8E, 0x00, 0x02, 0xE0, 0x10, 0xD0, 0xF8, 0x4C, 0x00, 0x06};
+    Cpu stepped, batched;
+    stepped.program_write(program);
+    batched.program_write(program);
+    while (stepped.cycle_count < 1000)
+        stepped.execute_instruction();
+    batched.run_for(1000);
+    REQUIRE(batched.cycle_count == stepped.cycle_count);
+    REQUIRE(batched.PC == stepped.PC);
+    REQUIRE(batched.X == stepped.X);
+    REQUIRE(batched.PS.conv() == stepped.PS.conv());
+}
+
+TEST_CASE("Execution path does not allocate", "[CpuTests]") {
+    Cpu cpu;
+    cpu.memory.set(0x20, 0x00);
+    cpu.memory.set(0x21, 0x03);
+    // loop: LDA $0300,X; CLC; ADC #$01; STA ($20),Y; JSR sub; INX; INY; BNE loop; JMP loop
+    // sub:  PHA; PLA; RTS
+    cpu.program_write({0xBD, 0x00, 0x03, 0x18, 0x69, 0x01, 0x91, 0x20, 0x20, 0x12, 0x06, 0xE8, 0xC8, 0xD0, 0xF1,
+                       0x4C, 0x00, 0x06, 0x48, 0x68, 0x60});
+    cpu.run_for(1'000'000); // pages are allocated on their first write
+    std::size_t before = allocation_count;
+    for (int i = 0; i < 10'000'000; i++)
+        cpu.execute_instruction();
+    cpu.run_for(1'000'000);
+    REQUIRE(allocation_count == before);
+}
+
+TEST_CASE("Block cache matches the interpreter", "[CpuTests]") {
+    // LDX #$00; loop: LDA $0300,X; CLC; ADC #$03; STA $0300,X; JSR sub; INX; BNE loop; JMP loop
+    // sub: PHA; PLA; RTS
+    const uint8_t program[] = {0xA2, 0x00, 0xBD, 0x00, 0x03, 0x18, 0x69, 0x03, 0x9D, 0x00, 0x03, 0x20, 0x14, 0x06,
+                               0xE8, 0xD0, 0xF1, 0x4C, 0x02, 0x06, 0x48, 0x68, 0x60};
+    Cpu interpreted, cached;
+    interpreted.program_write(program);
+    cached.program_write(program);
+    cached.enable_block_cache();
+    interpreted.run_for(100000);
+    cached.run_for(100000);
+    REQUIRE(cached.cycle_count == interpreted.cycle_count);
+    REQUIRE(cached.PC == interpreted.PC);
+    REQUIRE(cached.A == interpreted.A);
+    REQUIRE(cached.X == interpreted.X);
+    REQUIRE(cached.PS.conv() == interpreted.PS.conv());
+    REQUIRE(same_memory(cached.memory, interpreted.memory));
+    REQUIRE(cached.block_cache->decode_count() < 10); // static code is decoded once, not once per pass
+}
+
+TEST_CASE("Block cache sees self-modifying code", "[CpuTests]") {
+    Cpu cpu;
+    cpu.enable_block_cache();
+    SECTION("Write into an earlier block") {
+        // loop: LDA #$00; CLC; ADC #$01; STA loop+1; JMP loop
+        cpu.program_write({0xA9, 0x00, 0x18, 0x69, 0x01, 0x8D, 0x01, 0x06, 0x4C, 0x00, 0x06});
+        cpu.run_for(13 * 5); // five passes
+        REQUIRE(cpu.memory.get(0x0601) == 5);
+        REQUIRE(cpu.A == 5);
+    }
+    SECTION("Write ahead in the running block") {
+        // loop: LDA #$E8; STA patch; patch: NOP; JMP loop -- the NOP is turned into INX on the first pass.
+        cpu.program_write({0xA9, 0xE8, 0x8D, 0x05, 0x06, 0xEA, 0x4C, 0x00, 0x06});
+        cpu.run_for(11 * 3); // three passes
+        REQUIRE(cpu.X == 3);
+    }
+    SECTION("program_write invalidates") {
+        cpu.program_write({0xA9, 0x01, 0x4C, 0x00, 0x06}); // loop: LDA #$01; JMP loop
+        cpu.run_for(10);
+        REQUIRE(cpu.A == 1);
+        cpu.PC = 0x0600;
+        cpu.program_write({0xA9, 0x02});
+        cpu.run_for(10);
+        REQUIRE(cpu.A == 2);
+    }
+}
+
+TEST_CASE("Block cache does not read I/O pages ahead of time", "[CpuTests]") {
+    // NOPs at $06F0-$06FF, then a device on page $07 whose registers all read as NOP.
+    struct Nops{
+        int reads = 0;
+        static uint8_t on_read(void* context, uint16_t){
+            static_cast<Nops*>(context)->reads++;
+            return 0xEA;
+        }
+    };
+    for (bool cached : {false, true}){
+        Cpu cpu;
+        Nops device;
+        cpu.memory.map_io(0x07, 1, Nops::on_read, nullptr, &device);
+        for (uint16_t addr = 0x06F0; addr < 0x0700; addr++)
+            cpu.memory.set(addr, 0xEA);
+        cpu.PC = 0x06F0;
+        if (cached)
+            cpu.enable_block_cache();
+        INFO((cached ? "block cache" : "interpreter"));
+        cpu.run_for(8);
+        REQUIRE(cpu.PC == 0x06F4);
+        REQUIRE(device.reads == 0);
+        cpu.run_for(12 * 2 + 4 * 2); // the rest of page $06, then four NOPs fetched from the device
+        REQUIRE(cpu.PC == 0x0704);
+        REQUIRE(device.reads == 4);
+    }
+}
+
+TEST_CASE("Block cache fetches count for read watchpoints", "[CpuTests]") {
+    int hits = 0;
+    Cpu cpu;
+    cpu.program_write({0xE8, 0x4C, 0x00, 0x06}); // loop: INX; JMP loop
+    cpu.enable_block_cache();
+    cpu.run_for(50 * 5);
+    Mem::Watchpoint watch;
+    watch.first = watch.last = 0x0600;
+    watch.on_read = true;
+    watch.on_write = false;
+    watch.handler = [](void* context, uint16_t, uint8_t, bool){ (*static_cast<int*>(context))++; };
+    watch.context = &hits;
+    cpu.memory.add_watchpoint(watch); // the loop has been decoded already
+    cpu.run_for(10 * 5);
+    REQUIRE(hits == 10);
+}
+
+TEST_CASE("JIT matches the interpreter", "[CpuTests]") {
+    // outer: LDY #$10
+    // inner: TYA; EOR #$5A; ADC #$37; SBC #$11; CMP #$40; AND #$F3; ORA #$04; TAX; CPX #$80; INX; DEX; DEY; CPY #$00; BNE inner
+    //        SED; ADC #$19; SBC #$05; CLD; TSX; TXS; INY; NOP; CLV; SEC; STA $0300,Y; JMP outer
+    const uint8_t program[] = {0xA0, 0x10,
+                               0x98, 0x49, 0x5A, 0x69, 0x37, 0xE9, 0x11, 0xC9, 0x40, 0x29, 0xF3, 0x09, 0x04, 0xAA,
+                               0xE0, 0x80, 0xE8, 0xCA, 0x88, 0xC0, 0x00, 0xD0, 0xE9,
+                               0xF8, 0x69, 0x19, 0xE9, 0x05, 0xD8, 0xBA, 0x9A, 0xC8, 0xEA, 0xB8, 0x38,
+                               0x99, 0x00, 0x03, 0x4C, 0x00, 0x06};
+    Cpu interpreted, compiled;
+    interpreted.program_write(program);
+    compiled.program_write(program);
+    if (!compiled.enable_jit())
+        return; // no JIT on this host
+    for (int slice = 0; slice < 50; slice++){
+        interpreted.run_for(997);
+        compiled.run_for(997);
+        REQUIRE(compiled.cycle_count == interpreted.cycle_count);
+        REQUIRE(compiled.PC == interpreted.PC);
+        REQUIRE(compiled.A == interpreted.A);
+        REQUIRE(compiled.X == interpreted.X);
+        REQUIRE(compiled.Y == interpreted.Y);
+        REQUIRE(compiled.SP == interpreted.SP);
+        REQUIRE(compiled.PS.conv() == interpreted.PS.conv());
+    }
+    REQUIRE(same_memory(compiled.memory, interpreted.memory));
+    REQUIRE(compiled.block_cache->jit()->compiled_count() > 0);
+}
+
+TEST_CASE("JIT sees self-modifying code", "[CpuTests]") {
+    Cpu cpu;
+    if (!cpu.enable_jit())
+        return;
+    // loop: LDA #$00; CLC; ADC #$01; STA loop+1; JMP loop
+    cpu.program_write({0xA9, 0x00, 0x18, 0x69, 0x01, 0x8D, 0x01, 0x06, 0x4C, 0x00, 0x06});
+    cpu.run_for(13 * 100); // well past the point where the block gets compiled
+    REQUIRE(cpu.memory.get(0x0601) == 100);
+    REQUIRE(cpu.A == 100);
+}
+
+TEST_CASE("JIT leaves handler-only blocks to the interpreter", "[CpuTests]") {
+    Cpu cpu;
+    if (!cpu.enable_jit())
+        return;
+    // loop: LDA $10; STA $11; INC $10; JMP loop -- nothing can be inlined
+    cpu.program_write({0xA5, 0x10, 0x85, 0x11, 0xE6, 0x10, 0x4C, 0x00, 0x06});
+    cpu.run_for(14 * 100);
+    REQUIRE(cpu.memory.get(0x10) == 100);
+    REQUIRE(cpu.block_cache->jit()->compiled_count() == 0);
+    REQUIRE(cpu.block_cache->lookup(0x0600)->native == nullptr);
+}
+
+TEST_CASE("Status flags read back after lazy updates", "[CpuTests]") {
+    Cpu cpu;
+    // LDA #$80; PHP; LDA #$00; PHP; LDX #$01; PHP
+    cpu.program_write({0xA9, 0x80, 0x08, 0xA9, 0x00, 0x08, 0xA2, 0x01, 0x08});
+    for (int i = 0; i < 6; i++)
+        cpu.execute_instruction();
+    REQUIRE((cpu.memory.get(0x01FD) & 0x82) == 0x80);
+    REQUIRE((cpu.memory.get(0x01FC) & 0x82) == 0x02);
+    REQUIRE((cpu.memory.get(0x01FB) & 0x82) == 0x00);
+    cpu.PS.set(0x82);
+    REQUIRE(cpu.PS.N == 1);
+    REQUIRE(cpu.PS.Z == 1);
+    REQUIRE(cpu.PS.conv() == 0x82);
+}
+
+TEST_CASE("Threaded interpreter matches the interpreter", "[CpuTests]") {
+    // Same program as the block cache test: loads, stores, arithmetic, JSR/RTS and branches.
+    const uint8_t program[] = {0xA2, 0x00, 0xBD, 0x00, 0x03, 0x18, 0x69, 0x03, 0x9D, 0x00, 0x03, 0x20, 0x14, 0x06,
+                               0xE8, 0xD0, 0xF1, 0x4C, 0x02, 0x06, 0x48, 0x68, 0x60};
+    Cpu stepped, threaded;
+    stepped.program_write(program);
+    threaded.program_write(program);
+    for (int slice = 0; slice < 20; slice++){
+        cycle_timestamp target = stepped.cycle_count + 4999;
+        while (stepped.cycle_count < target)
+            stepped.execute_instruction();
+        threaded.slice_end = target;
+        threaded.cycle_count = run_threaded(threaded, threaded.cycle_count);
+        REQUIRE(threaded.cycle_count == stepped.cycle_count);
+        REQUIRE(threaded.PC == stepped.PC);
+        REQUIRE(threaded.A == stepped.A);
+        REQUIRE(threaded.X == stepped.X);
+        REQUIRE(threaded.SP == stepped.SP);
+        REQUIRE(threaded.PS.conv() == stepped.PS.conv());
+    }
+    REQUIRE(same_memory(threaded.memory, stepped.memory));
+}
+
+TEST_CASE("Superinstructions match the interpreter", "[CpuTests]") {
+    // outer: LDX #$05
+    // inner: LDA $10; STA $11; LDA #$07; STA $12; INY; CPY #$03; BNE skip; LDY #$00
+    // skip:  DEX; BNE inner; INC $10; CMP #$00; BEQ outer; JMP outer
+    const uint8_t program[] = {0xA2, 0x05, 0xA5, 0x10, 0x85, 0x11, 0xA9, 0x07, 0x85, 0x12, 0xC8, 0xC0, 0x03,
+                               0xD0, 0x02, 0xA0, 0x00, 0xCA, 0xD0, 0xEE, 0xE6, 0x10, 0xC9, 0x00, 0xF0, 0xE6,
+                               0x4C, 0x00, 0x06};
+    REQUIRE(superinstruction(0xCA, 0xD0) != nullptr);
+    REQUIRE(superinstruction(0xD0, 0xCA) == nullptr);
+    Cpu interpreted, cached;
+    interpreted.program_write(program);
+    cached.program_write(program);
+    cached.enable_block_cache();
+    for (int slice = 0; slice < 500; slice++){
+        // Odd budgets, so that runs also stop right after the first instruction of a pair.
+        cycles budget = slice % 13 + 1;
+        REQUIRE(cached.run_for(budget) == interpreted.run_for(budget));
+        REQUIRE(cached.PC == interpreted.PC);
+        REQUIRE(cached.A == interpreted.A);
+        REQUIRE(cached.X == interpreted.X);
+        REQUIRE(cached.Y == interpreted.Y);
+        REQUIRE(cached.PS.conv() == interpreted.PS.conv());
+    }
+    REQUIRE(same_memory(cached.memory, interpreted.memory));
+}
+
+TEST_CASE("Superinstructions do not delay interrupts raised by their first half", "[CpuTests]") {
+    // Zero page is a device: reads raise an IRQ, writes are recorded.
+    struct Irq{
+        Cpu* cpu;
+        std::vector<uint16_t> writes;
+        static uint8_t on_read(void* context, uint16_t){
+            static_cast<Irq*>(context)->cpu->set_irq(true);
+            return 0x42;
+        }
+        static void on_write(void* context, uint16_t addr, uint8_t){
+            static_cast<Irq*>(context)->writes.push_back(addr);
+        }
+    };
+    for (bool cached : {false, true}){
+        Cpu cpu;
+        Irq device{&cpu, {}};
+        cpu.memory.map_io(0x00, 1, Irq::on_read, Irq::on_write, &device);
+        cpu.memory.set(Cpu::IRQ_VECTOR, 0x00);
+        cpu.memory.set(Cpu::IRQ_VECTOR + 1, 0x07);
+        cpu.memory.set(0x0700, 0x4C); // handler: JMP handler
+        cpu.memory.set(0x0701, 0x00);
+        cpu.memory.set(0x0702, 0x07);
+        cpu.program_write({0x58,        // CLI
+                           0xA5, 0x10,  // LDA $10
+                           0x85, 0x20,  // STA $20
+                           0x4C, 0x05, 0x06}); // JMP *
+        if (cached)
+            cpu.enable_block_cache();
+        INFO((cached ? "block cache" : "interpreter"));
+        cpu.run_until(40);
+        REQUIRE(cpu.A == 0x42);
+        REQUIRE(device.writes.empty()); // the IRQ is taken before STA
+        REQUIRE(cpu.PC >= 0x0700);
+    }
+}
+
+TEST_CASE("Second half of a superinstruction sees its own start cycle", "[CpuTests]") {
+    struct Latch{
+        Cpu* cpu;
+        std::vector<cycle_timestamp> writes;
+        static void on_write(void* context, uint16_t, uint8_t){
+            auto* latch = static_cast<Latch*>(context);
+            latch->writes.push_back(latch->cpu->cycle_count);
+        }
+    };
+    Cpu cpu;
+    Latch latch{&cpu, {}};
+    cpu.memory.map_io(0x00, 1, nullptr, Latch::on_write, &latch);
+    cpu.program_write({0xA9, 0x01,        // loop: LDA #$01
+                       0x85, 0x00,        // STA $00 (fused with LDA)
+                       0x4C, 0x00, 0x06}); // JMP loop
+    cpu.enable_block_cache();
+    REQUIRE(superinstruction(0xA9, 0x85) != nullptr);
+    cpu.run_for(100);
+    REQUIRE(latch.writes.size() >= 10);
+    for (std::size_t i = 0; i < latch.writes.size(); i++)
+        REQUIRE(latch.writes[i] == 2 + 8 * i); // STA starts after LDA's two cycles, every eight-cycle iteration
+}
+
+TEST_CASE("Opcode pair profile", "[CpuTests]") {
+    Cpu cpu;
+    cpu.program_write({0xCA, 0xD0, 0xFD}); // loop: DEX; BNE loop
+    cpu.enable_pair_profile();
+    cpu.run_for(5 * 200); // DEX (2) + taken BNE (3), X counts down from 0
+    auto top = cpu.pair_profile->top(2);
+    REQUIRE(top.size() == 2);
+    REQUIRE(top[0].first == 0xCA);
+    REQUIRE(top[0].second == 0xD0);
+    REQUIRE(top[0].count == 200);
+    REQUIRE(top[1].count == 199);
+    REQUIRE(top[0].to_string() == "CA D0  DEX (IMPLIED) -> BNE (REL): 200");
+}
+
+TEST_CASE("Forks share memory copy-on-write", "[CpuTests]") {
+    Cpu parent;
+    parent.program_write({0xA9, 0x07,        // LDA #$07
+                          0x85, 0x10,        // STA $10
+                          0x8D, 0x00, 0x30,  // STA $3000
+                          0x4C, 0x07, 0x06}); // JMP * ($0607)
+    parent.memory.set(0x3001, 0x42);
+    parent.execute_instruction(); // LDA
+
+    auto child = parent.fork();
+    REQUIRE(child->PC == parent.PC);
+    REQUIRE(child->A == 0x07);
+    REQUIRE(child->cycle_count == parent.cycle_count);
+    REQUIRE(child->memory.get(0x3001) == 0x42);
+    REQUIRE(child->memory.pages[0x30].read == parent.memory.pages[0x30].read);
+
+    child->run_for(10); // STA $10 (a page never written, so allocated rather than copied); STA $3000; JMP
+    REQUIRE(child->memory.get(0x10) == 0x07);
+    REQUIRE(child->memory.get(0x3000) == 0x07);
+    REQUIRE(child->memory.get(0x3001) == 0x42);
+    REQUIRE(child->memory.copied_pages == 1);
+    REQUIRE(parent.memory.get(0x10) == 0);
+    REQUIRE(parent.memory.get(0x3000) == 0);
+    REQUIRE(parent.memory.copied_pages == 0);
+
+    // The parent still shares the pages the child did not write, so its own writes copy them.
+    parent.memory.set(0x3001, 0x43); // no longer shared: written in place
+    parent.memory.set(0x0620, 0x01);
+    REQUIRE(parent.memory.copied_pages == 1);
+    REQUIRE(child->memory.get(0x3001) == 0x42);
+    REQUIRE(child->memory.get(0x0620) == 0);
+
+    // Forks of forks, and mirrors of shared pages.
+    child->memory.mirror(0x40, 0x10, 0x30, 0x01);
+    auto grandchild = child->fork();
+    grandchild->memory.set(0x4500, 0x99);
+    REQUIRE(grandchild->memory.get(0x3000) == 0x99);
+    REQUIRE(child->memory.get(0x3000) == 0x07);
+    REQUIRE(child->memory.get(0x4500) == 0x07);
+    REQUIRE(grandchild->memory.copied_pages == 1);
+}
+
+TEST_CASE("Scheduled events fire at their timestamps", "[CpuTests]") {
+    struct Log{
+        Cpu* cpu;
+        std::vector<std::pair<cycle_timestamp, cycle_timestamp>> fired; // due, cycle_count when fired
+
+        static void record(void* context, cycle_timestamp due){
+            auto* log = static_cast<Log*>(context);
+            log->fired.emplace_back(due, log->cpu->cycle_count);
+        }
+        /// Fires once more, 1000 cycles later.
+        static void repeat(void* context, cycle_timestamp due){
+            record(context, due);
+            static_cast<Log*>(context)->cpu->scheduler.schedule(due + 1000, record, context);
+        }
+    };
+    for (int cached = 0; cached < 2; cached++){
+        Cpu cpu;
+        cpu.program_write({0xEA, 0xE8, 0x4C, 0x00, 0x06}); // loop: NOP; INX; JMP loop
+        if (cached)
+            cpu.enable_block_cache();
+        Log log{&cpu, {}};
+        cpu.scheduler.schedule(100, Log::record, &log);
+        cpu.scheduler.schedule(50, Log::record, &log);
+        auto cancelled = cpu.scheduler.schedule(60, Log::record, &log);
+        cpu.scheduler.schedule(50, Log::repeat, &log);
+        REQUIRE(cpu.scheduler.cancel(cancelled));
+        REQUIRE(!cpu.scheduler.cancel(cancelled));
+        REQUIRE(cpu.scheduler.next() == 50);
+
+        cpu.run_for(2000);
+        REQUIRE(log.fired.size() == 4);
+        REQUIRE(log.fired[0].first == 50);
+        REQUIRE(log.fired[1].first == 50); // same cycle: in the order they were scheduled
+        REQUIRE(log.fired[2].first == 100);
+        REQUIRE(log.fired[3].first == 1050);
+        for (auto [due, now] : log.fired){
+            REQUIRE(now >= due);
+            REQUIRE(now < due + 7); // stopped within one instruction of the event
+        }
+        REQUIRE(cpu.scheduler.pending() == 0);
+
+        // Single stepping fires events too.
+        cpu.scheduler.schedule(cpu.cycle_count + 1, Log::record, &log);
+        cpu.execute_instruction();
+        REQUIRE(log.fired.size() == 5);
+    }
+}
+
+TEST_CASE("IRQ and NMI lines", "[CpuTests]") {
+    /// Interrupt source that is acknowledged by any write to its register at $4000.
+    struct Device{
+        Cpu* cpu;
+        static void write(void* context, uint16_t, uint8_t){
+            static_cast<Device*>(context)->cpu->set_irq(false, 2);
+        }
+        static void raise_irq(void* context, cycle_timestamp){
+            static_cast<Device*>(context)->cpu->set_irq(true, 2);
+        }
+        static void pulse_nmi(void* context, cycle_timestamp due){
+            Cpu& cpu = *static_cast<Device*>(context)->cpu;
+            cpu.set_nmi(true);
+            cpu.scheduler.schedule(due + 100, [](void* c, cycle_timestamp){
+                static_cast<Device*>(c)->cpu->set_nmi(false);
+            }, context);
+        }
+    };
+    for (int mode = 0; mode < 3; mode++){
+        Cpu cpu;
+        Device device{&cpu};
+        cpu.memory.map_io(0x40, 1, nullptr, Device::write, &device);
+        cpu.program_write({0x58,              // CLI
+                           0xE8,              // loop: INX
+                           0x4C, 0x01, 0x06}); // JMP loop
+        const uint8_t irq_handler[] = {0xE6, 0x10, 0x8D, 0x00, 0x40, 0x40}; // INC $10; STA $4000; RTI
+        const uint8_t nmi_handler[] = {0xE6, 0x11, 0x40};                   // INC $11; RTI
+        for (std::size_t i = 0; i < sizeof(irq_handler); i++)
+            cpu.memory.set(0x0800 + i, irq_handler[i]);
+        for (std::size_t i = 0; i < sizeof(nmi_handler); i++)
+            cpu.memory.set(0x0700 + i, nmi_handler[i]);
+        cpu.memory.set(Cpu::IRQ_VECTOR + 1, 0x08);
+        cpu.memory.set(Cpu::NMI_VECTOR + 1, 0x07);
+        if (mode == 1)
+            cpu.enable_block_cache();
+        if (mode == 2)
+            cpu.enable_jit();
+
+        // Held while I is set: taken right after CLI, and only once because the handler acknowledges it.
+        REQUIRE(cpu.PS.I == 1);
+        cpu.set_irq(true, 2);
+        cpu.run_for(1000);
+        REQUIRE(cpu.memory.get(0x10) == 1);
+        REQUIRE((cpu.memory.get(0x01FB) & 0x30) == 0x20); // pushed status: B clear
+        REQUIRE(cpu.PS.I == 0); // restored by RTI
+
+        // Raised by a device event, taken at the event's timestamp.
+        cpu.scheduler.schedule(cpu.cycle_count + 500, Device::raise_irq, &device);
+        uint8_t before = cpu.X;
+        cpu.run_for(1000);
+        REQUIRE(cpu.memory.get(0x10) == 2);
+        REQUIRE(cpu.X != before);
+
+        // Masked by I.
+        cpu.PS.I = 1;
+        cpu.set_irq(true, 2);
+        cpu.run_for(1000);
+        REQUIRE(cpu.memory.get(0x10) == 2);
+        cpu.set_irq(false, 2);
+        cpu.PS.I = 0;
+
+        // NMI: one per rising edge, even while I is set and the line stays high.
+        cpu.PS.I = 1;
+        cpu.scheduler.schedule(cpu.cycle_count + 100, Device::pulse_nmi, &device);
+        cpu.scheduler.schedule(cpu.cycle_count + 600, Device::pulse_nmi, &device);
+        cpu.run_for(2000);
+        REQUIRE(cpu.memory.get(0x11) == 2);
+        REQUIRE(cpu.memory.get(0x10) == 2);
+    }
+}
+
+TEST_CASE("BRK and PHP push the B flag", "[CpuTests]") {
+    Cpu cpu;
+    cpu.memory.set(Cpu::IRQ_VECTOR, 0x00);
+    cpu.memory.set(Cpu::IRQ_VECTOR + 1, 0x07);
+    cpu.PS.I = 0;
+    cpu.program_write({0x08, 0x00}); // PHP; BRK
+    cpu.execute_instruction();
+    REQUIRE((cpu.memory.get(0x01FD) & 0x30) == 0x30);
+    cpu.execute_instruction();
+    REQUIRE(cpu.PC == 0x0700);
+    REQUIRE(cpu.PS.I == 1);
+    REQUIRE(cpu.memory.get(0x01FC) == 0x06); // return address skips the padding byte: $0603
+    REQUIRE(cpu.memory.get(0x01FB) == 0x03);
+    REQUIRE((cpu.memory.get(0x01FA) & 0x34) == 0x30); // B set; I was clear when pushed
+}
+
+TEST_CASE("Devices catch up when touched or when their events fire", "[CpuTests]") {
+    /// Counts cycles since its register at $4000 was last written; reads return the low byte.
+    /// With an alarm period set, also counts alarms without being touched.
+    struct Timer : Device{
+        cycle_timestamp counter = 0;
+        int advances = 0, accesses = 0, alarms = 0;
+        cycle_timestamp period = 0;
+
+        explicit Timer(Cpu& cpu) : Device(cpu){ map_registers(0x40, 1); }
+        void start_alarm(cycle_timestamp every){
+            period = every;
+            schedule(synced_to() + period);
+        }
+    protected:
+        void advance(cycle_timestamp from, cycle_timestamp to) override{
+            counter += to - from;
+            advances++;
+        }
+        uint8_t read(uint16_t) override{
+            accesses++;
+            return (uint8_t)counter;
+        }
+        void write(uint16_t, uint8_t) override{
+            accesses++;
+            counter = 0;
+        }
+        void on_event(cycle_timestamp due) override{
+            alarms++;
+            schedule(due + period);
+        }
+    };
+    for (int mode = 0; mode < 3; mode++){
+        Cpu cpu;
+        cpu.program_write({0xEA, 0xEA,        // loop: NOP; NOP
+                           0xAD, 0x00, 0x40,  // LDA $4000
+                           0x85, 0x00,        // STA $00
+                           0x8D, 0x00, 0x40,  // STA $4000
+                           0x4C, 0x00, 0x06}); // JMP loop
+        if (mode == 1)
+            cpu.enable_block_cache();
+        if (mode == 2)
+            cpu.enable_jit();
+        Timer timer(cpu);
+
+        // Read at the cycle LDA starts: after two NOPs, then after STA, JMP and two NOPs.
+        cpu.run_for(10);
+        REQUIRE(cpu.memory.get(0x00) == 4);
+        cpu.run_for(1000);
+        REQUIRE(cpu.memory.get(0x00) == 11);
+        REQUIRE(timer.advances <= timer.accesses); // only run forward when touched
+
+        // Left alone, it only runs at its events.
+        cpu.PC = 0x0600;
+        cpu.program_write({0xE8, 0x4C, 0x00, 0x06}); // loop: INX; JMP loop
+        timer.advances = 0;
+        timer.start_alarm(100);
+        cycle_timestamp start = timer.synced_to();
+        cpu.run_for(1000);
+        REQUIRE(timer.alarms >= 9);
+        REQUIRE(timer.advances == timer.alarms);
+        REQUIRE(timer.synced_to() == start + 100 * timer.alarms);
+        timer.sync();
+        REQUIRE(timer.synced_to() == cpu.cycle_count);
+    }
+}
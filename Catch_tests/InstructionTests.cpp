@@ -4,6 +4,7 @@
 
 #include "catch.hpp"
 #include <instruction.hpp>
+#include <bcd.hpp>
 
 /*
  * Only the underlying instruction is tested, not the addressing modes. Therefore, only one addressing mode will be used
@@ -381,4 +382,84 @@ TEST_CASE("BCD Subtraction Tests", "[InstructionTests]") {
     REQUIRE(cpu.PS.C == 1);
     REQUIRE(cpu.PS.N == 0);
     REQUIRE(cpu.PS.V == 0);
-}
\ No newline at end of file
+}
+
+TEST_CASE("BCD known answers", "[InstructionTests]") {
+    struct Vector{
+        uint8_t opcode, a, data;
+        bool carry_in;
+        uint8_t result;
+        bool carry_out;
+    };
+    const Vector vectors[] = {
+        {0x69, 0x09, 0x01, false, 0x10, false}, // ADC: digit carry
+        {0x69, 0x99, 0x01, false, 0x00, true},
+        {0x69, 0x15, 0x26, true, 0x42, false},
+        {0x69, 0x50, 0x50, false, 0x00, true},
+        {0xE9, 0x00, 0x01, true, 0x99, false}, // SBC: borrow out of both digits
+        {0xE9, 0x42, 0x13, true, 0x29, true},
+        {0xE9, 0x10, 0x10, false, 0x99, false},
+        {0xE9, 0x46, 0x12, true, 0x34, true},
+    };
+    for (const Vector& v : vectors){
+        Cpu cpu;
+        cpu.program_write({v.opcode, v.data});
+        cpu.A = v.a;
+        cpu.PS.set(0x08 | v.carry_in); // D
+        cpu.execute_instruction();
+        INFO("opcode " << (int)v.opcode << ", A " << (int)v.a << ", operand " << (int)v.data << ", C " << v.carry_in);
+        REQUIRE(cpu.A == v.result);
+        REQUIRE(cpu.PS.C == v.carry_out);
+        REQUIRE(cpu.PS.Z == (v.result == 0));
+    }
+}
+
+TEST_CASE("BCD tables match the arithmetic", "[InstructionTests]") {
+    // Every (A, operand, C), for the handlers and, when ENABLE_BCD_TABLES is set, for the tables they then use.
+    Cpu cpu;
+    std::size_t table_mismatches = 0, handler_mismatches = 0;
+    for (unsigned a = 0; a < 0x100; a++){
+        for (unsigned data = 0; data < 0x100; data++){
+            for (bool carry : {false, true}){
+                for (bool add : {true, false}){
+                    bcd::Result expected = add ? bcd::adc(a, data, carry) : bcd::sbc(a, data, carry);
+                    #if ENABLE_BCD_TABLES
+                    const bcd::Result& table = bcd::lookup(add ? bcd::adc_table : bcd::sbc_table, a, data, carry);
+                    table_mismatches += table.value != expected.value || table.flags != expected.flags;
+                    #endif
+
+                    cpu.PC = 0x0600;
+                    cpu.program_write({(uint8_t)(add ? 0x69 : 0xE9), (uint8_t)data}); // ADC/SBC #data
+                    cpu.A = a;
+                    cpu.PS.set(bcd::V | bcd::Z | 0x08 | carry); // D set, stale V and Z
+                    cpu.execute_instruction();
+                    handler_mismatches += cpu.A != expected.value || (cpu.PS.conv() & 0xC3) != expected.flags;
+                }
+            }
+        }
+    }
+    REQUIRE(table_mismatches == 0);
+    REQUIRE(handler_mismatches == 0);
+}
+
+TEST_CASE("Base cycles match handlers", "[InstructionTests]") {
+    // With zeroed operands and index registers no page is crossed, so every handler should take its base time.
+    for (int opcode = 0; opcode < 0x100; opcode++) {
+        const InstructionInfo& info = instruction_info.get(opcode);
+        if (info.opcode != opcode || info.mode == RELATIVE) // unimplemented or branch
+            continue;
+        Cpu cpu;
+        cpu.program_write({(uint8_t)opcode, 0x00, 0x00});
+        INFO(info.to_string());
+        REQUIRE(cpu.execute_instruction() == instruction_table.get(opcode).base_cycles);
+    }
+}
+
+TEST_CASE("Disassembly", "[InstructionTests]") {
+    Cpu cpu;
+    cpu.program_write({0xBD, 0x34, 0x12, 0xA9, 0x10, 0xD0, 0xFE});
+    REQUIRE(instruction_info.get(0xBD).length == 3);
+    REQUIRE(instruction_info.get(0xBD).to_string() == "LDA (ABS_X)");
+    REQUIRE(DecompiledInstruction(instruction_info, cpu.memory, 0x0600).to_string() == "$0600: LDA $1234,X");
+    REQUIRE(DecompiledInstruction(instruction_info, cpu.memory, 0x0603).to_string() == "$0603: LDA #$10");
+}
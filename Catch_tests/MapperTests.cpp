@@ -0,0 +1,198 @@
+//
+// Cartridge mapper tests, run against a set of generated iNES images.
+//
+
+#include "catch.hpp"
+#include <instruction.hpp>
+#include <mapper.hpp>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    /** Builds a test ROM for `mapper` with the given number of 16KB PRG and 8KB CHR banks.
+     *
+     * Every PRG bank starts with `LDA #bank; JMP ($0000)` and is otherwise filled with its bank number. Every 1KB of CHR is
+     * filled with `bank << 3 | kilobyte`. `program` is placed at the start of the last PRG bank, which is where the
+     * reset vector points ($C000 at power-on for every supported mapper).
+     */
+    std::vector<uint8_t> make_rom(uint8_t mapper, uint8_t prg_banks, uint8_t chr_banks,
+                                  const std::vector<uint8_t>& program = {}){
+        std::vector<uint8_t> image = {'N', 'E', 'S', 0x1A, prg_banks, chr_banks, (uint8_t)(mapper << 4),
+                                      (uint8_t)(mapper & 0xF0), 0, 0, 0, 0, 0, 0, 0, 0};
+        for (uint8_t bank = 0; bank < prg_banks; bank++){
+            std::vector<uint8_t> prg(Cartridge::PRG_BANK_SIZE, bank);
+            prg[0] = 0xA9; // LDA #bank
+            prg[2] = 0x6C; // JMP ($0000)
+            prg[3] = 0x00;
+            prg[4] = 0x00;
+            if (bank == prg_banks - 1){
+                std::copy(program.begin(), program.end(), prg.begin() + 5);
+                prg[0x3FFC] = 0x05; // reset vector: $C005
+                prg[0x3FFD] = 0xC0;
+            }
+            image.insert(image.end(), prg.begin(), prg.end());
+        }
+        for (uint8_t bank = 0; bank < chr_banks; bank++){
+            for (std::size_t i = 0; i < Cartridge::CHR_BANK_SIZE; i++)
+                image.push_back((uint8_t)(bank << 3 | i / Mapper::CHR_WINDOW));
+        }
+        return image;
+    }
+
+    /// STA $addr for every bit of `value`, lowest first, as MMC1 expects (uses A, LSR).
+    std::vector<uint8_t> mmc1_write(uint16_t addr, uint8_t value){
+        std::vector<uint8_t> code = {0xA9, value}; // LDA #value
+        for (int bit = 0; bit < 5; bit++){
+            code.insert(code.end(), {0x8D, (uint8_t)addr, (uint8_t)(addr >> 8)}); // STA addr
+            code.push_back(0x4A); // LSR A
+        }
+        return code;
+    }
+}
+
+TEST_CASE("iNES images are parsed", "[MapperTests]") {
+    Cartridge cart = Cartridge::from_ines(make_rom(0x12, 2, 1));
+    REQUIRE(cart.mapper == 0x12);
+    REQUIRE(cart.prg.size() == 2 * Cartridge::PRG_BANK_SIZE);
+    REQUIRE(cart.chr.size() == Cartridge::CHR_BANK_SIZE);
+    REQUIRE(cart.prg[1] == 0);
+    REQUIRE(cart.prg[Cartridge::PRG_BANK_SIZE + 1] == 1);
+
+    auto image = make_rom(0, 1, 0);
+    image[6] |= 0x04; // trainer
+    image.insert(image.begin() + 16, 512, 0xEE);
+    REQUIRE(Cartridge::from_ines(image).prg[0] == 0xA9);
+
+    image.resize(image.size() - 1);
+    REQUIRE_THROWS_AS(Cartridge::from_ines(image), std::runtime_error);
+    REQUIRE_THROWS_AS(Cartridge::from_ines({'N', 'E', 'S'}), std::runtime_error);
+    Mem memory;
+    REQUIRE_THROWS_AS(Mapper::create(Cartridge::from_ines(make_rom(4, 1, 1)), memory), std::runtime_error);
+}
+
+TEST_CASE("NROM mirrors 16KB programs", "[MapperTests]") {
+    Mem memory;
+    auto mapper = Mapper::create(Cartridge::from_ines(make_rom(0, 1, 1)), memory);
+    REQUIRE(memory.get(0x8000) == 0xA9);
+    REQUIRE(memory.get(0xC000) == 0xA9);
+    REQUIRE(memory.get(0xFFFD) == 0xC0);
+    memory.set(0x8010, 0x55); // ROM
+    REQUIRE(memory.get(0x8010) == 0);
+    REQUIRE(mapper->chr_read(0x1C00) == 7);
+}
+
+TEST_CASE("UxROM switches the $8000 bank", "[MapperTests]") {
+    const std::vector<uint8_t> program = {
+        0xA9, 0x01, 0x8D, 0x00, 0x80,             // C005: LDA #1; STA $8000
+        0xA9, 0x15, 0x85, 0x00, 0xA9, 0xC0, 0x85, 0x01, // return to $C015
+        0x4C, 0x00, 0x80,                         // C012: JMP $8000
+        0x85, 0x10,                               // C015: STA $10
+        0xA9, 0x02, 0x8D, 0x00, 0x80,             // LDA #2; STA $8000
+        0xA9, 0x23, 0x85, 0x00,                   // return to $C023
+        0x4C, 0x00, 0x80,                         // C020: JMP $8000
+        0x85, 0x11,                               // C023: STA $11
+        0xAD, 0x10, 0x80, 0x85, 0x12,             // LDA $8010; STA $12
+        0x4C, 0x2A, 0xC0};                        // C02A: JMP *
+    for (int cached = 0; cached < 2; cached++){
+        Cpu cpu;
+        auto mapper = Mapper::create(Cartridge::from_ines(make_rom(2, 8, 0, program)), cpu.memory);
+        cpu.reset();
+        REQUIRE(cpu.PC == 0xC005);
+        if (cached)
+            cpu.enable_block_cache();
+        for (int round = 0; round < 3; round++){
+            for (uint16_t addr = 0x10; addr <= 0x12; addr++)
+                cpu.memory.set(addr, 0);
+            cpu.PC = 0xC005;
+            cpu.run_for(100);
+            REQUIRE(cpu.memory.get(0x10) == 1);
+            REQUIRE(cpu.memory.get(0x11) == 2);
+            REQUIRE(cpu.memory.get(0x12) == 2);
+        }
+        REQUIRE(cpu.memory.get(0xD000) == 7); // last bank stays fixed
+        // The window points into the cartridge; nothing was copied.
+        REQUIRE(cpu.memory.pages[0x80].read == mapper->cartridge().prg.data() + 2 * Cartridge::PRG_BANK_SIZE);
+    }
+}
+
+TEST_CASE("MMC1 loads its registers serially", "[MapperTests]") {
+    std::vector<uint8_t> program;
+    for (auto& part : {mmc1_write(0xE000, 0x02),     // PRG bank 2 at $8000
+                       mmc1_write(0x8000, 0x1C),     // 4KB CHR, last PRG bank fixed at $C000
+                       mmc1_write(0xA000, 0x05),     // CHR bank 5 at $0000
+                       mmc1_write(0xC000, 0x02)})    // CHR bank 2 at $1000
+        program.insert(program.end(), part.begin(), part.end());
+    program.insert(program.end(), {0x4C, 0x00, 0x00}); // JMP $0000 (BRK)
+    Cpu cpu;
+    auto mapper = Mapper::create(Cartridge::from_ines(make_rom(1, 4, 4, program)), cpu.memory);
+    cpu.reset();
+    REQUIRE(cpu.memory.get(0x9000) == 0);
+    REQUIRE(cpu.memory.get(0xD000) == 3);
+    while (cpu.PC != 0x0000)
+        cpu.execute_instruction();
+    REQUIRE(cpu.memory.get(0x9000) == 2);
+    REQUIRE(cpu.memory.get(0xD000) == 3);
+    REQUIRE(mapper->chr_read(0x0000) == (2 << 3 | 4)); // 4KB bank 5: second half of 8KB bank 2
+    REQUIRE(mapper->chr_read(0x1400) == (1 << 3 | 1)); // 4KB bank 2: first half of 8KB bank 1
+
+    auto write = [&](uint16_t addr, uint8_t value){
+        for (int bit = 0; bit < 5; bit++)
+            cpu.memory.set(addr, value >> bit);
+    };
+    write(0xE000, 0x03);
+    REQUIRE(cpu.memory.get(0x9000) == 3);
+    write(0x8000, 0x00); // 32KB mode ignores the low bit of the PRG bank
+    REQUIRE(cpu.memory.get(0x9000) == 2);
+    REQUIRE(cpu.memory.get(0xD000) == 3);
+    cpu.memory.set(0x8000, 0x80); // reset: back to a fixed last bank
+    REQUIRE(cpu.memory.get(0x9000) == 3);
+    REQUIRE(cpu.memory.get(0xD000) == 3);
+
+    // PRG RAM.
+    cpu.memory.set(0x6123, 0x42);
+    REQUIRE(cpu.memory.get(0x6123) == 0x42);
+    REQUIRE(cpu.memory.ram(0x6123) == 0);
+}
+
+TEST_CASE("CNROM switches CHR banks", "[MapperTests]") {
+    Mem memory;
+    auto mapper = Mapper::create(Cartridge::from_ines(make_rom(3, 2, 4)), memory);
+    REQUIRE(mapper->chr_read(0x0400) == 1);
+    memory.set(0x8000, 3);
+    REQUIRE(mapper->chr_read(0x0400) == (3 << 3 | 1));
+    REQUIRE(memory.get(0x8010) == 0);
+    REQUIRE(memory.get(0xC010) == 1);
+}
+
+TEST_CASE("Removing a mapper unmaps the cartridge", "[MapperTests]") {
+    Mem memory;
+    memory.set(0x8010, 0x99);
+    {
+        auto mapper = Mapper::create(Cartridge::from_ines(make_rom(2, 2, 0)), memory);
+        REQUIRE(memory.get(0x8010) == 0);
+    }
+    REQUIRE(memory.get(0x8010) == 0x99);
+}
+
+TEST_CASE("Machines running the same cartridge share its ROM", "[MapperTests]") {
+    auto cartridge = std::make_shared<const Cartridge>(Cartridge::from_ines(make_rom(2, 4, 0)));
+    std::vector<std::unique_ptr<Cpu>> machines;
+    std::vector<std::unique_ptr<Mapper>> mappers;
+    for (int i = 0; i < 4; i++){
+        machines.push_back(std::make_unique<Cpu>());
+        mappers.push_back(Mapper::create(cartridge, machines.back()->memory));
+    }
+    REQUIRE(cartridge.use_count() == 5);
+    for (auto& machine : machines)
+        REQUIRE(machine->memory.pages[0xC0].read == cartridge->prg.data() + 3 * Cartridge::PRG_BANK_SIZE);
+
+    machines[1]->memory.set(0x8010, 2); // bank switch on one machine only; the byte itself is not written
+    REQUIRE(machines[0]->memory.get(0x9000) == 0);
+    REQUIRE(machines[1]->memory.get(0x9000) == 2);
+    REQUIRE(machines[0]->memory.get(0x8010) == 0);
+    REQUIRE(cartridge->prg[2 * Cartridge::PRG_BANK_SIZE + 0x10] == 2);
+
+    mappers.clear();
+    REQUIRE(cartridge.use_count() == 1);
+}
@@ -0,0 +1,275 @@
+//
+// Memory bus tests.
+//
+
+#include "catch.hpp"
+#include <instruction.hpp>
+#include <rom_image.hpp>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+    /// Device with one latch that counts reads and records writes.
+    struct Latch{
+        uint8_t value = 0;
+        int reads = 0;
+        std::vector<std::pair<uint16_t, uint8_t>> writes;
+
+        static uint8_t read(void* context, uint16_t){
+            auto* self = static_cast<Latch*>(context);
+            self->reads++;
+            return self->value;
+        }
+        static void write(void* context, uint16_t addr, uint8_t value){
+            auto* self = static_cast<Latch*>(context);
+            self->writes.emplace_back(addr, value);
+            self->value = value;
+        }
+    };
+}
+
+TEST_CASE("Unmapped pages are backed by RAM", "[MemTests]") {
+    Mem memory;
+    memory.set(0x1234, 0x56);
+    REQUIRE(memory.ram(0x1234) == 0x56);
+    REQUIRE(memory.get(0x1234) == 0x56);
+    memory.set(0xFFFF, 0x78);
+    REQUIRE(memory.get(0xFFFF) == 0x78);
+}
+
+TEST_CASE("RAM pages are allocated on first write", "[MemTests]") {
+    Cpu cpu;
+    REQUIRE(cpu.memory.allocated_pages() == 0);
+    REQUIRE(cpu.memory.get(0x1234) == 0);
+    REQUIRE(cpu.memory.pages[0x12].read == cpu.memory.pages[0x34].read); // both show the zero page
+    cpu.program_write({0xA9, 0x05,        // LDA #$05
+                       0x85, 0x80,        // STA $80
+                       0x8D, 0x80, 0x12}); // STA $1280
+    cpu.run_for(2 + 3 + 4);
+    REQUIRE(cpu.memory.allocated_pages() == 3); // $00, $06 and $12
+    REQUIRE(cpu.memory.get(0x1280) == 5);
+    REQUIRE(cpu.memory.get(0x3480) == 0);
+
+    auto fork = cpu.fork();
+    cpu.memory.reset();
+    REQUIRE(cpu.memory.allocated_pages() == 0);
+    REQUIRE(cpu.memory.get(0x1280) == 0);
+    REQUIRE(fork->memory.get(0x1280) == 5);
+}
+
+TEST_CASE("Mem stays small", "[MemTests]") {
+    // Fast pointers and mappings for 256 pages, frame pointers and a few bitsets; RAM and I/O callbacks live outside.
+    REQUIRE(sizeof(Mem::Mapping) <= 16);
+    REQUIRE(sizeof(Mem) <= 11 * 1024);
+
+    // Devices that come and go do not use up the 255 I/O handler slots.
+    Mem memory;
+    Latch devices[2];
+    for (int i = 0; i < 1000; i++)
+        memory.map_io(0x40, 1, Latch::read, Latch::write, &devices[i % 2]);
+    REQUIRE(memory.io_handlers.size() == 3);
+    std::vector<Latch> many(300);
+    for (Latch& device : many)
+        memory.map_io(0x41, 1, Latch::read, Latch::write, &device);
+    memory.set(0x4100, 0x12);
+    REQUIRE(many.back().writes.back() == std::pair<uint16_t, uint8_t>(0x4100, 0x12));
+    REQUIRE(memory.io_handlers.size() <= 256);
+}
+
+TEST_CASE("I/O pages go through the device", "[MemTests]") {
+    Cpu cpu;
+    Latch device;
+    cpu.memory.map_io(0x40, 1, Latch::read, Latch::write, &device);
+    cpu.program_write({0xA9, 0x42,        // LDA #$42
+                       0x8D, 0x17, 0x40,  // STA $4017
+                       0xAE, 0x17, 0x40}); // LDX $4017
+    cpu.run_for(2 + 4 + 4);
+    REQUIRE(device.writes.size() == 1);
+    REQUIRE(device.writes[0] == std::pair<uint16_t, uint8_t>(0x4017, 0x42));
+    REQUIRE(device.reads == 1);
+    REQUIRE(cpu.X == 0x42);
+    REQUIRE(cpu.memory.ram(0x4017) == 0); // RAM behind the page is untouched
+
+    cpu.memory.unmap(0x40, 1);
+    cpu.memory.set(0x4017, 0x99);
+    REQUIRE(device.value == 0x42);
+    REQUIRE(cpu.memory.get(0x4017) == 0x99);
+}
+
+TEST_CASE("ROM pages ignore writes", "[MemTests]") {
+    Mem memory;
+    std::vector<uint8_t> rom(2 * Mem::PAGE_SIZE);
+    for (std::size_t i = 0; i < rom.size(); i++)
+        rom[i] = (uint8_t)i;
+    memory.map_memory(0xFE, 2, rom.data(), false);
+    REQUIRE(memory.get(0xFE00) == 0x00);
+    REQUIRE(memory.get(0xFF01) == 0x01);
+    memory.set(0xFF01, 0xAA);
+    REQUIRE(memory.get(0xFF01) == 0x01);
+    REQUIRE(rom[0x101] == 0x01);
+}
+
+TEST_CASE("Mirrored pages share backing storage", "[MemTests]") {
+    Mem memory;
+    memory.mirror(0x08, 0x18, 0x00, 0x08); // 2KB of RAM repeated up to $1FFF
+    memory.set(0x0801, 0x11);
+    REQUIRE(memory.get(0x0001) == 0x11);
+    REQUIRE(memory.get(0x1801) == 0x11);
+    memory.set(0x1FFF, 0x22);
+    REQUIRE(memory.get(0x07FF) == 0x22);
+    REQUIRE(memory.ram(0x1FFF) == 0);
+    REQUIRE(memory.pages[0x18].read == memory.pages[0x00].read);
+
+    Latch device;
+    memory.map_io(0x20, 1, Latch::read, Latch::write, &device);
+    memory.mirror(0x21, 0x1F, 0x20, 1);
+    memory.set(0x3F05, 0x33);
+    REQUIRE(device.writes.back() == std::pair<uint16_t, uint8_t>(0x3F05, 0x33));
+    REQUIRE(memory.get(0x2000) == 0x33);
+}
+
+TEST_CASE("Writes through a mirror invalidate cached code", "[MemTests]") {
+    Cpu cpu;
+    cpu.memory.mirror(0x08, 0x18, 0x00, 0x08);
+    cpu.program_write({0xA9, 0x01,        // LDA #$01
+                       0x4C, 0x00, 0x06}); // JMP $0600
+    cpu.enable_block_cache();
+    cpu.run_for(50);
+    REQUIRE(cpu.A == 0x01);
+    cpu.memory.set(0x0E01, 0x02); // operand of LDA, through the mirror at $0800
+    cpu.run_for(50);
+    REQUIRE(cpu.A == 0x02);
+}
+
+TEST_CASE("ROM images are mapped without copying", "[MemTests]") {
+    // Named per run, so test processes running side by side do not overwrite each other's image.
+    auto name = "6502emu_rom_image_test_" + std::to_string(std::random_device{}()) + ".bin";
+    auto path = (std::filesystem::temp_directory_path() / name).string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        for (int i = 0; i < 0x1010; i++)
+            file.put((char)(i % 251));
+    }
+    Cpu cpu;
+    RomImage rom(path);
+    REQUIRE(rom.size() == 0x1010);
+    rom.map(cpu.memory, 0xE000);
+    REQUIRE(cpu.memory.pages[0xE0].read == rom.data());
+    REQUIRE(cpu.memory.get(0xE000) == 0);
+    REQUIRE(cpu.memory.get(0xF00F) == 0x100F % 251);
+    REQUIRE(cpu.memory.get(0xF010) == 0); // rest of the last page
+    REQUIRE(cpu.memory.get(0xF100) == 0); // RAM
+    cpu.memory.set(0xE001, 0xAA);
+    REQUIRE(cpu.memory.get(0xE001) == 1);
+
+    rom.map(cpu.memory, 0x0600, 0x10, 0x100); // unaligned offset
+    REQUIRE(cpu.memory.get(0x0600) == 0x10);
+    REQUIRE_THROWS_AS(rom.map(cpu.memory, 0x0610), std::runtime_error);
+    REQUIRE_THROWS_AS(rom.map(cpu.memory, 0xF000), std::runtime_error); // does not fit below $FFFF
+
+    RomImage moved = std::move(rom);
+    REQUIRE(moved.data() == cpu.memory.pages[0xE0].read);
+    REQUIRE(rom.data() == nullptr);
+    cpu.memory.unmap(0x00, Mem::PAGES);
+    std::remove(path.c_str());
+    REQUIRE_THROWS_AS(RomImage(path), std::runtime_error);
+}
+
+TEST_CASE("Written pages are marked dirty", "[MemTests]") {
+    Cpu cpu;
+    cpu.memory.mirror(0x08, 0x18, 0x00, 0x08);
+    REQUIRE(cpu.memory.take_dirty_pages().all());
+    REQUIRE(cpu.memory.dirty_pages.none());
+
+    cpu.memory.set(0x2345, 0x01);
+    cpu.memory.set(0x2346, 0x02);
+    REQUIRE(cpu.memory.dirty_pages.count() == 1);
+    REQUIRE(cpu.memory.dirty_pages[0x23]);
+    REQUIRE(cpu.memory.pages[0x23].write); // later writes to the page take the fast path again
+
+    cpu.program_write({0xA9, 0x42,        // LDA #$42
+                       0x8D, 0x00, 0x30,  // STA $3000
+                       0xEE, 0x10, 0x31,  // INC $3110
+                       0x85, 0x10});      // STA $10, also visible at $0810, $1010 and $1810
+    cpu.memory.take_dirty_pages();
+    cpu.run_for(2 + 4 + 6 + 3);
+    REQUIRE(cpu.memory.get(0x3110) == 1);
+    std::bitset<Mem::PAGES> dirty = cpu.memory.take_dirty_pages();
+    REQUIRE(dirty.count() == 6);
+    for (std::size_t page : {0x30, 0x31, 0x00, 0x08, 0x10, 0x18})
+        REQUIRE(dirty[page]);
+
+    Latch device;
+    std::vector<uint8_t> rom(Mem::PAGE_SIZE, 0xEA);
+    cpu.memory.map_io(0x40, 1, Latch::read, Latch::write, &device);
+    cpu.memory.map_rom(0xE0, 1, rom.data());
+    cpu.memory.set(0x4000, 1);
+    cpu.memory.set(0xE000, 1);
+    REQUIRE(cpu.memory.dirty_pages.none());
+    cpu.memory.reset();
+    REQUIRE(cpu.memory.dirty_pages.count() == Mem::PAGES - 2);
+}
+
+TEST_CASE("Watchpoints only slow down their own page", "[MemTests]") {
+    struct Hit{ uint16_t addr; uint8_t value; bool write; };
+    std::vector<Hit> hits;
+    auto record = [](void* context, uint16_t addr, uint8_t value, bool write){
+        static_cast<std::vector<Hit>*>(context)->push_back({addr, value, write});
+    };
+    Cpu cpu;
+    cpu.memory.set(0x0200, 0); // allocate the pages
+    cpu.memory.set(0x0300, 0);
+    REQUIRE(cpu.memory.pages[0x02].read);
+    REQUIRE(cpu.memory.pages[0x02].write);
+
+    Mem::Watchpoint watch;
+    watch.first = watch.last = 0x0210;
+    watch.on_read = true;
+    watch.handler = record;
+    watch.context = &hits;
+    int id = cpu.memory.add_watchpoint(watch);
+    REQUIRE(!cpu.memory.pages[0x02].read);
+    REQUIRE(!cpu.memory.pages[0x02].write);
+    REQUIRE(cpu.memory.pages[0x03].write);
+
+    cpu.program_write({0xA9, 0x42,        // LDA #$42
+                       0x8D, 0x10, 0x02,  // STA $0210
+                       0x8D, 0x11, 0x02,  // STA $0211, same page but not watched
+                       0xAE, 0x10, 0x02}); // LDX $0210
+    cpu.run_for(2 + 4 + 4 + 4);
+    REQUIRE(cpu.X == 0x42);
+    REQUIRE(cpu.memory.get(0x0211) == 0x42);
+    REQUIRE(hits.size() == 2);
+    REQUIRE((hits[0].addr == 0x0210 && hits[0].value == 0x42 && hits[0].write));
+    REQUIRE((hits[1].addr == 0x0210 && hits[1].value == 0x42 && !hits[1].write));
+
+    // Writes of odd values only, to a range across two pages.
+    Mem::Watchpoint odd;
+    odd.first = 0x30F0;
+    odd.last = 0x310F;
+    odd.mask = 0x01;
+    odd.match = 0x01;
+    odd.handler = record;
+    odd.context = &hits;
+    cpu.memory.add_watchpoint(odd);
+    hits.clear();
+    cpu.memory.set(0x30FF, 2);
+    cpu.memory.set(0x3100, 3);
+    cpu.memory.set(0x3110, 5);
+    REQUIRE(cpu.memory.get(0x3110) == 5);
+    REQUIRE(hits.size() == 1);
+    REQUIRE(hits[0].addr == 0x3100);
+    REQUIRE(cpu.memory.pages[0x31].read); // reads are not watched
+
+    cpu.memory.remove_watchpoint(id);
+    REQUIRE(cpu.memory.pages[0x02].read);
+    REQUIRE(cpu.memory.pages[0x02].write);
+    hits.clear();
+    cpu.memory.get(0x0210);
+    REQUIRE(hits.empty());
+}
@@ -0,0 +1,83 @@
+//
+// Real-time pacing tests. These run against the wall clock, so the bounds leave room for a busy host.
+//
+
+#include "catch.hpp"
+#include <instruction.hpp>
+#include <pacer.hpp>
+#include <chrono>
+#include <thread>
+
+TEST_CASE("Pacer holds emulated time to the wall clock", "[PacerTests]") {
+    Cpu cpu;
+    cpu.program_write({0xE8, 0x4C, 0x00, 0x06}); // loop: INX; JMP loop
+    auto start = Pacer::clock::now(); // before the pacer takes its anchor, so the wall time is never short
+    Pacer pacer(cpu);
+    pacer.run_for(0.1);
+    std::chrono::duration<double> wall = Pacer::clock::now() - start;
+
+    REQUIRE(cpu.elapsed_seconds() >= 0.1);
+    REQUIRE(wall.count() >= cpu.elapsed_seconds()); // never ahead of the wall clock
+    REQUIRE(wall.count() < cpu.elapsed_seconds() + 0.05);
+    REQUIRE(pacer.stats.batches >= 100);
+}
+
+TEST_CASE("Pacer catches up, and starts over when too far behind", "[PacerTests]") {
+    Cpu cpu;
+    cpu.program_write({0xE8, 0x4C, 0x00, 0x06}); // loop: INX; JMP loop
+    Pacer pacer(cpu);
+    pacer.run_batch();
+
+    // Behind, but within max_lag: the next batches run without waiting until the deadline is met again.
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    pacer.run_batch();
+    REQUIRE(pacer.deadline() + std::chrono::milliseconds(10) < Pacer::clock::now()); // did not wait: still behind
+    REQUIRE(pacer.stats.late_batches == 1);
+    REQUIRE(pacer.stats.max_lateness >= std::chrono::milliseconds(15));
+    REQUIRE(pacer.stats.resyncs == 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    auto before = Pacer::clock::now();
+    pacer.run_batch();
+    REQUIRE(pacer.stats.resyncs == 1);
+    REQUIRE(pacer.deadline() >= before); // the debt was dropped
+}
+
+TEST_CASE("Pacer runs at a multiple of real time or unlimited", "[PacerTests]") {
+    Cpu cpu;
+    cpu.program_write({0xE8, 0x4C, 0x00, 0x06}); // loop: INX; JMP loop
+    Pacer pacer(cpu);
+    REQUIRE_THROWS(pacer.set_pacing(Pacer::Pacing::multiplier, 0));
+
+    SECTION("Multiplier") {
+        auto start = Pacer::clock::now(); // before set_pacing re-anchors the pacer
+        pacer.set_pacing(Pacer::Pacing::multiplier, 4);
+        REQUIRE(pacer.speed() == 4);
+        pacer.run_for(0.2);
+        std::chrono::duration<double> wall = Pacer::clock::now() - start;
+        REQUIRE(wall.count() >= cpu.elapsed_seconds() / 4);
+        REQUIRE(wall.count() < cpu.elapsed_seconds() / 4 + 0.03);
+        REQUIRE(pacer.present_due());
+        REQUIRE(!pacer.present_due()); // decimated outside real time
+    }
+    SECTION("Unlimited") {
+        pacer.set_pacing(Pacer::Pacing::unlimited);
+        REQUIRE(pacer.speed() == 0);
+        auto start = Pacer::clock::now();
+        std::size_t presented = 0;
+        while (cpu.elapsed_seconds() < 2.0){
+            pacer.run_batch();
+            presented += pacer.present_due();
+        }
+        std::chrono::duration<double> wall = Pacer::clock::now() - start;
+        REQUIRE(wall.count() < 2.0);
+        REQUIRE(presented <= wall.count() * 60 + 1);
+        REQUIRE(pacer.stats.late_batches == 0);
+
+        // Back to real time without trying to catch up on the time skipped.
+        pacer.set_pacing(Pacer::Pacing::realtime);
+        pacer.run_batch();
+        REQUIRE(pacer.stats.late_batches == 0);
+        REQUIRE(pacer.present_due());
+    }
+}